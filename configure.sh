@@ -63,6 +63,34 @@ Where OPTIONS are:
                                 functions will be checked for their validity
                                 (ID's out of bounds, nullptrs, etc...) and will
                                 return if parameters are "invalid".
+
+        --soa-layout            Library is compiled with SOA_LAYOUT, which
+                                stores row tags, row data and prefetch requests
+                                in separate regions of each segment (structure
+                                of arrays) instead of interleaving them.
+
+        --row-alignment[=<n>]   Pads row metadata and entries so that every row
+                                in the rows and cache segments starts at a 
+                                multiple of n bytes (a power of 2). Default n 
+                                is 64 (a cache line).
+
+        --trace[=<n>]           Library is compiled with TRACE, which records
+                                the begin and end of every operation in a ring
+                                buffer of n events (default is 65536, must be a
+                                power of 2). The buffer is written as a Chrome
+                                trace by lazygaspi_term.
+
+        --event-log[=<n>]       Library is compiled with EVENT_LOG, which 
+                                records reads, writes, prefetches and clocks as
+                                binary records in a ring buffer of n records 
+                                (default is 65536, must be a power of 2). The
+                                buffer is written by lazygaspi_term and can be
+                                rendered as text with the log_decode tool.
+
+        --with-stats            Library is compiled with READ_STATS, which
+                                means per-table histograms of the staleness of
+                                read rows and of the time spent waiting for 
+                                fresh rows are collected by lazygaspi_read.
 EOF
 }
 
@@ -164,6 +192,30 @@ while getopts $allopts opt; do
         with-safety-checks)
             echo "CXXFLAGS+=-DSAFETY_CHECKS" >> $MAKE_INC
         ;;
+        soa-layout)
+            echo "CXXFLAGS+=-DSOA_LAYOUT" >> $MAKE_INC
+        ;;
+        row-alignment)
+            echo "CXXFLAGS+=-DROW_ALIGNMENT=64" >> $MAKE_INC
+        ;;
+        row-alignment=*)
+            echo "CXXFLAGS+=-DROW_ALIGNMENT=${OPTARG#*=}" >> $MAKE_INC
+        ;;
+        with-stats)
+            echo "CXXFLAGS+=-DREAD_STATS" >> $MAKE_INC
+        ;;
+        trace)
+            echo "CXXFLAGS+=-DTRACE" >> $MAKE_INC
+        ;;
+        trace=*)
+            echo "CXXFLAGS+=-DTRACE -DTRACE_BUFFER_SIZE=${OPTARG#*=}" >> $MAKE_INC
+        ;;
+        event-log)
+            echo "CXXFLAGS+=-DEVENT_LOG" >> $MAKE_INC
+        ;;
+        event-log=*)
+            echo "CXXFLAGS+=-DEVENT_LOG -DEVENT_LOG_BUFFER_SIZE=${OPTARG#*=}" >> $MAKE_INC
+        ;;
         esac
     ;;
     \?)
@@ -200,6 +252,7 @@ fi
 echo "WITH_MPI=$WITH_MPI" >> $MAKE_INC
 echo "INCLUDES+=-Iinclude" >> $MAKE_INC
 echo "LDLIBS+=-l$GASPI_LIBNAME" >> $MAKE_INC
+echo "LDLIBS+=-lrt" >> $MAKE_INC
 echo "PREFIX=$PREFIX" >> $MAKE_INC
 echo "LIB_STATIC=$LIB_STATIC" >> $MAKE_INC
 echo "EIGEN=$EIGEN" >> $MAKE_INC
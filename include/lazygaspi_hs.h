@@ -7,18 +7,60 @@
 
 #include <GASPI.h>
 #include <fstream>
+#include <cstdint>
 
-#define LAZYGASPI_ID_INFO 0 
-#define LAZYGASPI_ID_ROWS 1
-#define LAZYGASPI_ID_CACHE 2
-#define LAZYGASPI_ID_AVAIL 3
+//An instance is identified by the first of the segment ID's it uses. See lazygaspi_use_instance.
+typedef gaspi_segment_id_t lazygaspi_instance_t;
+
+//The instance that all functions called by the current thread act on. Set it with lazygaspi_use_instance.
+extern thread_local lazygaspi_instance_t lazygaspi_current_instance;
+
+//The amount of segment ID's used by an instance, starting at the instance's ID.
+#define LAZYGASPI_INSTANCE_SEGMENTS 4
+
+#define LAZYGASPI_ID_INFO (lazygaspi_current_instance + 0)
+#define LAZYGASPI_ID_ROWS (lazygaspi_current_instance + 1)
+#define LAZYGASPI_ID_CACHE (lazygaspi_current_instance + 2)
+#define LAZYGASPI_ID_NODE_CACHE (lazygaspi_current_instance + 3)
+//The first segment ID not used by the default instance (0). Further instances can use multiples of it.
+#define LAZYGASPI_ID_AVAIL LAZYGASPI_INSTANCE_SEGMENTS
 
 typedef unsigned long lazygaspi_id_t;
 typedef gaspi_atomic_value_t lazygaspi_age_t;
 typedef unsigned long lazygaspi_slack_t;
+//The priority of a prefetch request. Requests with a higher priority are fulfilled first.
+typedef unsigned char lazygaspi_priority_t;
+
+//The priority of the request registered by a read that waits for a pushed row (see LazyGaspiProcessInfo::wait_for_push).
+#define LAZYGASPI_PRIORITY_MAX 255
+
+#define LAZYGASPI_STALENESS_BUCKETS 16
+#define LAZYGASPI_WAIT_BUCKETS 32
+#define LAZYGASPI_DEFAULT_STAGING_BYTES (1 << 20)
+#define LAZYGASPI_DEFAULT_CACHE_MARGIN (1 << 20)
+//Cache size that makes lazygaspi_init allocate as many cache rows as memory allows. See CachingOptions.
+#define LAZYGASPI_CACHE_SIZE_AUTO ((gaspi_size_t)-1)
 
 struct LazyGaspiProcessInfo;
 
+//Histograms of the reads of one table. Only collected if the library was compiled with READ_STATS.
+struct LazyGaspiReadHistogram{
+    //staleness[i] is the amount of reads that returned a row i ages older than the reader's age. 
+    //The last bucket also counts all older rows.
+    unsigned long staleness[LAZYGASPI_STALENESS_BUCKETS];
+    //wait[0] is the amount of reads that found a fresh row in the cache. wait[i], for i > 0, is the amount of reads that 
+    //waited between 2^(i-1) and 2^i - 1 nanoseconds for a fresh row. The last bucket also counts all longer waits.
+    unsigned long wait[LAZYGASPI_WAIT_BUCKETS];
+};
+
+//Order of the rows in a file read by lazygaspi_load.
+enum LazyGaspiLoadFormat{
+    //All rows of table 0, then all rows of table 1, and so on.
+    LAZYGASPI_LOAD_BY_TABLE,
+    //Row 0 of every table, then row 1 of every table, and so on.
+    LAZYGASPI_LOAD_BY_ROW
+};
+
 struct ShardingOptions{
     //How many rows will be assigned to a given process at a time. For example, a value of one means rows are distributed one at 
     //a time through all processes, while a value equal to the size of a table means tables are assigned one at a time.
@@ -28,13 +70,34 @@ struct ShardingOptions{
 
 struct CachingOptions{
     typedef gaspi_offset_t (*CacheHash)(lazygaspi_id_t row_id, lazygaspi_id_t table_id, LazyGaspiProcessInfo* info);
+    //Reduces the amount of rows of a cache that could not be allocated. Should return less than size, or 0 to give up.
+    typedef gaspi_size_t (*CacheSizeReductor)(gaspi_size_t size, void* data);
     CacheHash hash;
-    //The size of the cache, in rows.
+    //The size of the cache, in rows, or LAZYGASPI_CACHE_SIZE_AUTO to allocate as many rows as memory allows. After 
+    //initialization, this is the amount of rows that were allocated.
     gaspi_size_t size;
-    CachingOptions(CacheHash hash, gaspi_size_t size) : hash(hash), size(size) {};
+    //The size, in bytes, of the region of the cache segment into which lazygaspi_read_range reads runs of rows. It always holds 
+    //at least one row, unless it is 0, in which case lazygaspi_read_range reads one row at a time. Default is 1 MiB.
+    gaspi_size_t staging_bytes;
+    //With LAZYGASPI_CACHE_SIZE_AUTO, the amount of memory, in bytes, left free after the cache is allocated. Default is 1 MiB.
+    gaspi_size_t margin;
+    //With LAZYGASPI_CACHE_SIZE_AUTO, the function that reduces the amount of rows after an allocation fails, starting with 
+    //all rows of all tables. Use nullptr to remove an eighth of the rows each time.
+    CacheSizeReductor reductor;
+    void* reductor_data;
+    //The size, in rows, of the cache shared by all ranks on the same host, which is checked for rows of other ranks after the 
+    //cache of the current rank, so that a row is only read over the network once by all of them. 0 disables it (default). After
+    //initialization, this is 0 if no other rank runs on the same host.
+    gaspi_size_t node_size;
+    CachingOptions(CacheHash hash, gaspi_size_t size, gaspi_size_t staging_bytes = LAZYGASPI_DEFAULT_STAGING_BYTES,
+                   gaspi_size_t margin = LAZYGASPI_DEFAULT_CACHE_MARGIN, CacheSizeReductor reductor = nullptr, 
+                   void* reductor_data = nullptr, gaspi_size_t node_size = 0) : 
+                   hash(hash), size(size), staging_bytes(staging_bytes), margin(margin), reductor(reductor), 
+                   reductor_data(reductor_data), node_size(node_size) {};
 };
 
-//None of the fields in this structure should be altered, except for the out and offset_slack fields.
+//None of the fields in this structure should be altered, except for the out, offset_slack, wait_for_push, push_timeout and 
+//write_back fields.
 struct LazyGaspiProcessInfo{
     //Value returned by gaspi_proc_rank.
     gaspi_rank_t id;
@@ -59,6 +122,28 @@ struct LazyGaspiProcessInfo{
     //If false, minimum age for read rows will be the current age minus the slack.
     //Default is true.
     bool offset_slack;
+    //True if a read that finds its row's rank still holding an old row should register a prefetch request for it and wait for
+    //the rank to push the row (in lazygaspi_fulfill_prefetches, or when the rank writes the row itself), instead of reading the 
+    //row again. Default is false.
+    bool wait_for_push;
+    //Time to wait for a pushed row, or for another rank to reach the age a read needs, in milliseconds, before reading the row 
+    //again. GASPI_BLOCK waits without a limit. Default is 10.
+    gaspi_timeout_t push_timeout;
+    //True if lazygaspi_write should only update the local cache and keep the row until the next lazygaspi_flush (called by 
+    //lazygaspi_clock), so that a row written many times per age is only sent once. Rows are sent through the staging region of
+    //the cache, so writes are never kept if CachingOptions::staging_bytes is 0. Default is false.
+    bool write_back;
+    //True if the rows of other ranks read with lazygaspi_read or lazygaspi_read_part should be recorded, so that lazygaspi_clock
+    //prefetches them for the next age, with the smallest slack they were last read with. Default is false.
+    bool auto_prefetch;
+    //The amount of ages after the last read of a row for which auto_prefetch keeps prefetching it. Default is 2.
+    lazygaspi_age_t auto_prefetch_history;
+    //The highest age of a row written by this rank.
+    lazygaspi_age_t write_age;
+    //The amount of entries reserved in the rows segment of every rank (the largest amount of rows assigned to any rank).
+    gaspi_offset_t rows_capacity;
+    //One read histogram per table, or nullptr if the library was not compiled with READ_STATS.
+    LazyGaspiReadHistogram* histograms;
 
     ShardingOptions shardOpts;
     CachingOptions cacheOpts;
@@ -82,12 +167,25 @@ struct LazyGaspiRowData{
  */
 typedef gaspi_size_t (*SizeDeterminer)(gaspi_rank_t rank, gaspi_rank_t total, void* data);
 
+/** A function that is called by lazygaspi_for_each_local for each row stored by the current rank.
+ *  Parameters:
+ *  row_id   - The row's ID.
+ *  table_id - The ID of the row's table.
+ *  row      - A pointer to the row, in the rows segment. Can be read and changed in place.
+ *  age      - The row's current age.
+ *  data     - User data passed to lazygaspi_for_each_local.
+ *  Returns:
+ *  true if the row was changed, in which case it is committed with the current rank's age (as if it had been written).
+ */
+typedef bool (*LocalRowVisitor)(lazygaspi_id_t row_id, lazygaspi_id_t table_id, void* row, lazygaspi_age_t age, void* data);
+
 /**A function that creates and sets the output file stream for the info segment.
  * Info is guaranteed to have fields `id` and `n` filled before this function is called. 
  */
 typedef void (*OutputCreator)(LazyGaspiProcessInfo* info);
 
-/** Initializes LazyGASPI.
+/** Initializes LazyGASPI. Creates the current instance (see lazygaspi_use_instance), and initializes GASPI if no other instance 
+ *  was initialized before. Must be called by all ranks.
  * 
  *  Parameters:
  *  table_amount    - The amount of tables, or 0 if size is to be determined by a SizeDeterminer.
@@ -107,6 +205,8 @@ typedef void (*OutputCreator)(LazyGaspiProcessInfo* info);
  *  Returns:
  *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
  *  GASPI_ERR_INV_NUM indicates that at least one of the three parameters was 0 and its SizeDeterminer was a nullptr or returned 0.
+ *  [Safety Check] GASPI_ERR_INV_SEG is returned if the current instance was already initialized, or if its segment ID's exceed
+ *  the maximum amount of segments.
  */
 gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_size, gaspi_size_t row_size, 
                               ShardingOptions shard_options = ShardingOptions(0), 
@@ -116,6 +216,22 @@ gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_
                               SizeDeterminer det_tablesize = nullptr, void* data_tablesize = nullptr, 
                               SizeDeterminer det_rowsize = nullptr, void* data_rowsize = nullptr);
 
+/** Selects the instance that all other functions act on, including lazygaspi_init. Each instance has its own tables, row size,
+ *  sharding and caching options, age and segments, which use the segment ID's from `instance` to 
+ *  `instance + LAZYGASPI_INSTANCE_SEGMENTS - 1`. The default instance is 0. All ranks must use the same instances.
+ *  The selection only applies to the calling thread, so threads can act on different instances at the same time. Every thread
+ *  starts with the default instance. lazygaspi_init and lazygaspi_term are serialized, but functions that hit a barrier for all
+ *  ranks must be called for the instances in the same order on all ranks.
+ * 
+ *  Parameters:
+ *  instance - The first segment ID of the instance. 
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success.
+ *  [Safety Check] GASPI_ERR_INV_SEG is returned if `instance` is not a multiple of LAZYGASPI_INSTANCE_SEGMENTS.
+ */
+gaspi_return_t lazygaspi_use_instance(lazygaspi_instance_t instance);
+
 /** Outputs a pointer to the "info" segment.
  *  
  *  Parameters:
@@ -140,11 +256,18 @@ gaspi_return_t lazygaspi_set_max_threads(unsigned int max_threads);
 
 /** Fulfills prefetch requests from other ranks. 
  *  Must be called by all processes at the end of each iteration for prefetching to work properly.
+ *  Requests are fulfilled by descending priority, and in storage order within the same priority. Requests that a row satisfies 
+ *  once the current rank writes it itself (with lazygaspi_write, lazygaspi_write_part or lazygaspi_for_each_local) are pushed 
+ *  right away instead, regardless of the budget.
+ *  
+ *  Parameters:
+ *  budget - The maximum amount of bytes (tags and rows) pushed by this call, or 0 for no limit. At least one row is always pushed.
+ *           Requests left over are fulfilled by the next call, even if no new request or row was written in the meantime.
  *  
  *  Returns:
  *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout. 
  */
-gaspi_return_t lazygaspi_fulfill_prefetches();
+gaspi_return_t lazygaspi_fulfill_prefetches(gaspi_size_t budget = 0);
 
 /** Writes prefetch requests on the proper ranks. The two arrays ought to have a size of `size`. 
  *  For a given index `i`, row_vec[i] from table_vec[i] will be requested for prefetching.
@@ -153,8 +276,9 @@ gaspi_return_t lazygaspi_fulfill_prefetches();
  * row_vec     - An array or row ID's.
  * table_vec   - An array of table ID's.
  * size        - The length of both arrays (or all 3, if "preferences" is used).
- * preferences - An array of preferences, where each index indicates the preference for the corresponding
- *               pair of table and row ID's. Use nullptr to indicate that all pairs are prefered.
+ * slack       - The amount of slack used.
+ * preferences - An array of priorities, where each index indicates the priority of the request for the corresponding
+ *               pair of table and row ID's. Use nullptr to request all pairs with priority 0.
  * 
  * Example:
  * row_vec:   0 1 2 3 4 5 0 2 4 6 7 8 5
@@ -167,9 +291,11 @@ gaspi_return_t lazygaspi_fulfill_prefetches();
  * GASPI_ERR_INV_NUM if either row_id or table_id is not a valid ID.
  * GASPI_ERR_NOINIT if `lazygaspi_clock`has not been called even once.
  */
-gaspi_return_t lazygaspi_prefetch(lazygaspi_id_t* row_vec, lazygaspi_id_t* table_vec, size_t size, lazygaspi_slack_t slack);
+gaspi_return_t lazygaspi_prefetch(lazygaspi_id_t* row_vec, lazygaspi_id_t* table_vec, size_t size, lazygaspi_slack_t slack,
+                                  const lazygaspi_priority_t* preferences = nullptr);
 
-/** Same as calling lazygaspi_prefetch on all rows of all tables.
+/** Same as calling lazygaspi_prefetch on all rows of all tables, except for rows whose cached copy is fresh and no older than the 
+ *  last write to its block of the rows segment.
  * 
  *  Parameters:
  *  slack - The amount of slack used.
@@ -196,6 +322,96 @@ gaspi_return_t lazygaspi_prefetch_all(lazygaspi_slack_t slack);
  */
 gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack, void* row, LazyGaspiRowData* data = nullptr);
 
+/** Reads `length` bytes, starting at `offset`, of a row whose age is within the given slack. If the cache holds a fresh copy of 
+ *  the row, the part is copied from it. Otherwise only the part and the row's tag are transferred, through the staging region
+ *  (see CachingOptions::staging_bytes), and the cache is not updated. Without a staging region, or with LOCKED_OPERATIONS, the
+ *  whole row is read instead.
+ * 
+ *  Parameters:
+ *  row_id   - The row's ID.
+ *  table_id - The ID of the row's table.
+ *  slack    - The slack allowed for the row that will be read.
+ *  offset   - The offset of the part, in bytes, from the start of the row.
+ *  length   - The size of the part, in bytes.
+ *  part     - Output parameter for the part. Must hold `length` bytes.
+ *  data     - Output parameter for the metadata tag associated with the read row. Use nullptr to ignore.
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  [Safety Check] GASPI_ERR_INV_NUM is returned if either row_id or table_id are invalid, or if the part exceeds the row.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if part is a nullptr.
+ *  [Safety Check] GASPI_ERR_NOINIT is returned if `lazygaspi_clock` has not been called even once.
+ */
+gaspi_return_t lazygaspi_read_part(lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack, gaspi_size_t offset,
+                                   gaspi_size_t length, void* part, LazyGaspiRowData* data = nullptr);
+
+/** Reads `count` consecutive rows of a table, whose ages are within the given slack. Rows whose cached copy is fresh and no older
+ *  than the last write to its block of the rows segment are copied from the cache. Others stored contiguously by the same rank 
+ *  are read with a single transfer per CachingOptions::staging_bytes, and only those that were still too old are read again, 
+ *  one at a time. Rows read this way are not kept in the cache. If compiled with LOCKED_OPERATIONS, rows are always read one 
+ *  at a time.
+ * 
+ *  Parameters:
+ *  table_id - The ID of the rows' table.
+ *  first    - The ID of the first row.
+ *  count    - The amount of rows.
+ *  slack    - The slack allowed for the rows that will be read.
+ *  rows     - Output parameter for the rows, which are stored one after the other. Must hold `count` rows.
+ *  data     - Output parameter for the metadata tags of the read rows (an array of `count` tags). Use nullptr to ignore.
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  [Safety Check] GASPI_ERR_INV_NUM is returned if table_id is invalid or if the range exceeds the table.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if rows is a nullptr.
+ *  [Safety Check] GASPI_ERR_NOINIT is returned if `lazygaspi_clock` has not been called even once.
+ */
+gaspi_return_t lazygaspi_read_range(lazygaspi_id_t table_id, lazygaspi_id_t first, lazygaspi_id_t count, lazygaspi_slack_t slack,
+                                    void* rows, LazyGaspiRowData* data = nullptr);
+
+/** Same as calling lazygaspi_read_range on all rows of a table. */
+gaspi_return_t lazygaspi_read_table(lazygaspi_id_t table_id, lazygaspi_slack_t slack, void* rows, LazyGaspiRowData* data = nullptr);
+
+/** Outputs the read histograms of a table, collected since initialization or since the last reset.
+ * 
+ *  Parameters:
+ *  table_id  - The ID of the table.
+ *  histogram - Output parameter for the histograms.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERR_NOINIT is returned if the library was not compiled with READ_STATS.
+ *  GASPI_ERR_INV_NUM is returned if table_id is invalid.
+ *  GASPI_ERR_NULLPTR is returned if histogram is a nullptr.
+ */
+gaspi_return_t lazygaspi_get_read_histogram(lazygaspi_id_t table_id, LazyGaspiReadHistogram* histogram);
+
+/** Resets the read histograms of all tables.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERR_NOINIT is returned if the library was not compiled with READ_STATS.
+ */
+gaspi_return_t lazygaspi_reset_read_histograms();
+
+/** Checks which of the given rows are already in the local cache with an age within the given slack, without any 
+ *  communication. The two arrays ought to have a size of `size`. The result is only a snapshot: a row that is fresh can still 
+ *  be replaced in the cache by another row before it is read.
+ * 
+ *  Parameters:
+ *  row_vec   - An array of row ID's.
+ *  table_vec - An array of table ID's.
+ *  size      - The length of both arrays.
+ *  slack     - The slack allowed for the rows.
+ *  bitmap    - Output parameter for the result. Bit `i % 64` of `bitmap[i / 64]` is set if row_vec[i] from table_vec[i] is 
+ *              fresh. Must hold at least (size + 63) / 64 words.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  [Safety Check] GASPI_ERR_INV_NUM is returned if any row or table ID is invalid.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if any array is a nullptr.
+ *  [Safety Check] GASPI_ERR_NOINIT is returned if `lazygaspi_clock` has not been called even once.
+ */
+gaspi_return_t lazygaspi_check_fresh(const lazygaspi_id_t* row_vec, const lazygaspi_id_t* table_vec, size_t size, 
+                                     lazygaspi_slack_t slack, uint64_t* bitmap);
+
 /** Writes the given row in the appropriate server.
  *  
  *  Parameters:
@@ -203,6 +419,9 @@ gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, la
  *  table_id - The ID of the row's table.
  *  row      - A pointer to the row's data. Size is assumed to be the same as the size passed to lazygaspi_init.
  * 
+ *  If LazyGaspiProcessInfo::write_back is true, the row is only written to the local cache and kept until the next call to
+ *  lazygaspi_flush. Writing the same row again before that replaces the kept row.
+ * 
  *  Returns:
  *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
  *  GASPI_ERR_INV_NUM is returned if either row_id or table_id are invalid.
@@ -210,14 +429,117 @@ gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, la
  */
 gaspi_return_t lazygaspi_write(lazygaspi_id_t row_id, lazygaspi_id_t table_id, void* row);
 
-/** Increments the current process's age by 1.
+/** Writes `length` bytes, starting at `offset`, of the given row in the appropriate server. The rest of the stored row is left as 
+ *  it was, and the row's age becomes the current age. The part is sent through one entry of the staging region (see
+ *  CachingOptions::staging_bytes), so up to as many partial writes as there are entries can be in flight.
+ * 
+ *  A cached copy of the row is updated with the part, but keeps its age, since the rest of it might be older. In write-back
+ *  mode, the part is merged into the kept row if there is one, and sent with it by lazygaspi_flush.
+ * 
+ *  Parameters:
+ *  row_id   - The row's ID.
+ *  table_id - The ID of the row's table.
+ *  offset   - The offset of the part, in bytes, from the start of the row.
+ *  length   - The size of the part, in bytes.
+ *  part     - A pointer to the part's data.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERR_INV_SEGSIZE is returned if there is no staging region.
+ *  [Safety Check] GASPI_ERR_INV_NUM is returned if either row_id or table_id are invalid, or if the part exceeds the row.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if part is a nullptr.
+ *  [Safety Check] GASPI_ERR_NOINIT is returned if `lazygaspi_clock` has not been called even once.
+ */
+gaspi_return_t lazygaspi_write_part(lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_size_t offset, gaspi_size_t length,
+                                    const void* part);
+
+/** Sends the rows kept by lazygaspi_write in write-back mode to the ranks that store them, each row once, with the age it was
+ *  written with. Rows are grouped by rank, and the rows of different ranks are sent through different queues.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ */
+gaspi_return_t lazygaspi_flush();
+
+/** Calls `visitor` for every row stored by the current rank, in the order in which they are stored, with a pointer to the row
+ *  itself. Rows the visitor reports as changed are committed in place with the current age, and prefetch requests for them are
+ *  fulfilled by the next call to lazygaspi_fulfill_prefetches. No rows are copied or transferred.
+ * 
+ *  Parameters:
+ *  visitor - The function called for each row.
+ *  data    - User data passed to every call of visitor.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if visitor is a nullptr.
+ *  [Safety Check] GASPI_ERR_NOINIT is returned if `lazygaspi_clock` has not been called even once.
+ */
+gaspi_return_t lazygaspi_for_each_local(LocalRowVisitor visitor, void* data = nullptr);
+
+/** Sends all rows kept in write-back mode (see lazygaspi_flush), then increments the current process's age by 1.
+ *  If LazyGaspiProcessInfo::auto_prefetch is true, the rows of other ranks read in the last auto_prefetch_history ages are then
+ *  prefetched for the new age, unless the cache already holds them fresh.
  * 
  *  Returns:
  *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
  */
 gaspi_return_t lazygaspi_clock();
 
-/* Terminates LazyGASPI. 
+/** Starts writing a checkpoint of the rows stored by the current rank to the file "<path>.<rank>", and returns without waiting
+ *  for it to be written. Only rows that changed since the last checkpoint to (or restore from) the same path are written, even if
+ *  they were written again without changing their age; all rows are written to a new path. Rows are copied before this returns, so computation can go on while the file is written.
+ *  Waits for the previous checkpoint, if it is still being written.
+ * 
+ *  Parameters:
+ *  path - The prefix of the checkpoint file's name.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERROR is also returned if the previous checkpoint could not be written.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if path is a nullptr.
+ */
+gaspi_return_t lazygaspi_checkpoint(const char* path);
+
+/** Waits until the last checkpoint started by lazygaspi_checkpoint is written to its file.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success (or if there is no checkpoint being written), GASPI_ERROR if the checkpoint could not be written.
+ */
+gaspi_return_t lazygaspi_checkpoint_wait();
+
+/** Restores the rows stored by the current rank, and the current rank's age, from the checkpoint file "<path>.<rank>". 
+ *  Must be called by all ranks right after lazygaspi_init, with the same parameters used when the checkpoint was taken. 
+ *  Hits a barrier for all ranks.
+ * 
+ *  Parameters:
+ *  path - The prefix of the checkpoint file's name, as passed to lazygaspi_checkpoint.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERROR is also returned if the file could not be opened.
+ *  GASPI_ERR_INV_NUM is returned if the file is not a checkpoint of the current rank with the current parameters.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if path is a nullptr.
+ */
+gaspi_return_t lazygaspi_restore(const char* path);
+
+/** Loads the initial contents of all tables from a file, which must hold `row_size` bytes for every row of every table, in the 
+ *  order given by `format`. Each rank maps the file and copies only the rows it stores into its rows segment, tagging them with 
+ *  the current age (or 1, before the first call to lazygaspi_clock). Must be called by all ranks. Hits a barrier for all ranks.
+ * 
+ *  Parameters:
+ *  path   - The path to the file. Must be accessible to all ranks (e.g., on a shared file system).
+ *  format - The order of the rows in the file.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ *  GASPI_ERROR is also returned if the file could not be opened.
+ *  GASPI_ERR_INV_NUM is returned if the file's size does not match the size of all tables.
+ *  [Safety Check] GASPI_ERR_INV_NUM is returned if format is invalid.
+ *  [Safety Check] GASPI_ERR_NULLPTR is returned if path is a nullptr.
+ */
+gaspi_return_t lazygaspi_load(const char* path, LazyGaspiLoadFormat format = LAZYGASPI_LOAD_BY_TABLE);
+
+/* Terminates the current instance, and GASPI if no other instance remains. 
  *
  * Returns:
  * GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
@@ -0,0 +1,184 @@
+#include "lazygaspi_hs.h"
+#include "gaspi_utils.h"
+#include "utils.h"
+#include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+//Default values
+#define ITERATIONS 10
+
+void print_usage();
+
+struct BenchParams{
+    lazygaspi_id_t table_size, table_amount, block_size;
+    gaspi_size_t row_size, cache_size;
+    unsigned iterations;
+};
+
+enum ReadKind { READ_HIT, READ_TAG_MISS, READ_AGE_MISS };
+
+/** Classifies the next read of a row by the state of its cache slot. */
+ReadKind classify_read(LazyGaspiProcessInfo* info, gaspi_pointer_t cache, lazygaspi_id_t row, lazygaspi_id_t table, 
+                       lazygaspi_age_t min){
+    const auto tag = (RowTag*)((char*)cache + cache_tag_offset(info, get_offset_in_cache(info, row, table)));
+    if(tag->row_id != row || tag->table_id != table) return READ_TAG_MISS;
+    return tag->age >= min ? READ_HIT : READ_AGE_MISS;
+}
+
+/** Reduces the latencies (in seconds) measured by all ranks for one operation and prints them as a JSON object on rank 0. 
+ *  Must be called by all ranks, in the same order.
+ *  `items` is the amount of rows handled by each measured call. */
+void report(LazyGaspiProcessInfo* info, const BenchParams& p, const char* op, std::vector<double>& latencies, 
+            double items = 1){
+    std::sort(latencies.begin(), latencies.end());
+    const double count = latencies.size();
+    double total = 0;
+    for(auto l : latencies) total += l;
+    const auto percentile = [&](double q){ return count ? latencies[(size_t)(q * (count - 1))] : 0.0; };
+
+    //Sums: calls, rows per second, mean latency. Maxima: mean, p50, p99 and maximum latency.
+    double sums[3] = { count, total > 0 ? count * items / total : 0.0, count ? total / count : 0.0 }, sums_out[3];
+    double maxs[4] = { count ? total / count : 0.0, percentile(0.5), percentile(0.99), count ? latencies.back() : 0.0 }, maxs_out[4];
+    SUCCESS_OR_DIE(gaspi_allreduce(sums, sums_out, 3, GASPI_OP_SUM, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+    SUCCESS_OR_DIE(gaspi_allreduce(maxs, maxs_out, 4, GASPI_OP_MAX, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+
+    if(info->id != 0) return;
+    std::cout << "{\"op\": \"" << op << "\", \"ranks\": " << info->n << ", \"table_size\": " << p.table_size 
+              << ", \"table_amount\": " << p.table_amount << ", \"row_size\": " << info->row_size 
+              << ", \"block_size\": " << info->shardOpts.block_size << ", \"cache_size\": " << info->cacheOpts.size
+              << ", \"iterations\": " << p.iterations
+              #ifdef LOCKED_OPERATIONS
+              << ", \"locked\": true"
+              #else
+              << ", \"locked\": false"
+              #endif
+              #ifdef SOA_LAYOUT
+              << ", \"layout\": \"soa\""
+              #else
+              << ", \"layout\": \"aos\""
+              #endif
+              << ", \"row_alignment\": " << ROW_ALIGNMENT
+              << ", \"calls\": " << (unsigned long)sums_out[0] << ", \"rows_per_call\": " << items
+              << ", \"throughput_rows_per_s\": " << sums_out[1]
+              << ", \"latency_us\": {\"mean\": " << sums_out[2] / info->n * 1e6 << ", \"max_rank_mean\": " << maxs_out[0] * 1e6
+              << ", \"p50\": " << maxs_out[1] * 1e6 << ", \"p99\": " << maxs_out[2] * 1e6 << ", \"max\": " << maxs_out[3] * 1e6 
+              << "}}" << std::endl;
+}
+
+int main(int argc, char** argv){
+    int         ch;
+    BenchParams p = { 0, 0, 0, 0, 0, ITERATIONS };
+
+    while((ch = getopt(argc, argv, "hk:n:r:b:c:i:")) != -1) {
+        switch(ch){
+            case 'k': p.table_size = atol(optarg); break;
+            case 'n': p.table_amount = atol(optarg); break;
+            case 'r': p.row_size = atol(optarg); break;
+            case 'b': p.block_size = atol(optarg); break;
+            case 'c': p.cache_size = atol(optarg); break;
+            case 'i': p.iterations = atol(optarg); break;
+            case '?': 
+            case ':':
+            default : print_usage(); exit(EXIT_FAILURE);
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+        }
+    }
+
+    if(p.table_size == 0 || p.table_amount == 0 || p.row_size == 0 || p.iterations == 0){
+        print_usage(); exit(EXIT_FAILURE);
+    }
+
+    SUCCESS_OR_DIE_COUT(lazygaspi_init(p.table_amount, p.table_size, p.row_size, ShardingOptions(p.block_size), 
+                                       CachingOptions(LAZYGASPI_HS_HASH_ROW, p.cache_size)));
+
+    LazyGaspiProcessInfo* info;
+    SUCCESS_OR_DIE_COUT(lazygaspi_get_info(&info));
+    //Minimum age is the current age, so that every first read of a row after it is written is an age miss.
+    info->offset_slack = false;
+
+    gaspi_pointer_t cache;
+    SUCCESS_OR_DIE(gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache));
+
+    std::vector<lazygaspi_id_t> all_rows, all_tables, own_rows, own_tables;
+    for(lazygaspi_id_t table = 0; table < p.table_amount; table++)
+    for(lazygaspi_id_t row = 0; row < p.table_size; row++){
+        all_rows.push_back(row);
+        all_tables.push_back(table);
+        if(get_row_location(info, row, table).first == info->id){
+            own_rows.push_back(row);
+            own_tables.push_back(table);
+        }
+    }
+
+    auto buffer = (char*)malloc(p.row_size);
+    memset(buffer, 0, p.row_size);
+
+    std::vector<double> write, reads[3], prefetch, prefetch_all, fulfill;
+    const lazygaspi_slack_t slack = 0;
+
+    for(unsigned it = 0; it < p.iterations; it++){
+        SUCCESS_OR_DIE(lazygaspi_clock());
+        const auto min = get_min_age(info->age, slack, info->offset_slack);
+
+        for(size_t i = 0; i < own_rows.size(); i++){
+            const auto beg = get_time();
+            SUCCESS_OR_DIE(lazygaspi_write(own_rows[i], own_tables[i], buffer));
+            write.push_back(get_time() - beg);
+        }
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+
+        //First pass misses on age (or on tag, for small caches); second pass hits (or misses on tag).
+        for(int pass = 0; pass < 2; pass++)
+        for(size_t i = 0; i < all_rows.size(); i++){
+            const auto kind = classify_read(info, cache, all_rows[i], all_tables[i], min);
+            const auto beg = get_time();
+            SUCCESS_OR_DIE(lazygaspi_read(all_rows[i], all_tables[i], slack, buffer));
+            reads[kind].push_back(get_time() - beg);
+        }
+
+        auto beg = get_time();
+        SUCCESS_OR_DIE(lazygaspi_prefetch(all_rows.data(), all_tables.data(), all_rows.size(), slack));
+        prefetch.push_back(get_time() - beg);
+
+        beg = get_time();
+        SUCCESS_OR_DIE(lazygaspi_prefetch_all(slack));
+        prefetch_all.push_back(get_time() - beg);
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+
+        beg = get_time();
+        SUCCESS_OR_DIE(lazygaspi_fulfill_prefetches());
+        fulfill.push_back(get_time() - beg);
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+    }
+
+    report(info, p, "write", write);
+    report(info, p, "read_hit", reads[READ_HIT]);
+    report(info, p, "read_tag_miss", reads[READ_TAG_MISS]);
+    report(info, p, "read_age_miss", reads[READ_AGE_MISS]);
+    report(info, p, "prefetch", prefetch, all_rows.size());
+    report(info, p, "prefetch_all", prefetch_all, all_rows.size());
+    report(info, p, "fulfill_prefetches", fulfill);
+
+    SUCCESS_OR_DIE(lazygaspi_term());
+
+    free(buffer);
+
+    return EXIT_SUCCESS;
+}
+
+void print_usage(){
+    std::cout << "Usage: gaspi_run <...args...> -k <rows_per_table> -n <amount_of_tables> -r <row_size> [-b <block_size>] [-c <cache_size>] [-i <iterations>]\n\n"
+              << "Parameters:\n"
+              << "  -k <rows_per_table>:    The amount of rows in one table.\n"
+              << "  -n <amount_of_tables>:  The total amount of tables.\n"
+              << "  -r <row_size>:          The size of a single row, in bytes.\n"
+              << "  [-b <block_size>]:      The sharding block size, in rows. Default is one table.\n"
+              << "  [-c <cache_size>]:      The size of the cache, in rows. Default is one table.\n"
+              << "  [-i <iterations>]:      The amount of iterations. Default is " << ITERATIONS << ".\n\n"
+              << "Results are printed by rank 0 as one JSON object per operation.\n"
+              << std::endl;
+}
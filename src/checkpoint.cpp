@@ -0,0 +1,269 @@
+#include "lazygaspi_hs.h"
+#include "utils.h"
+#include "gaspi_utils.h"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CHECKPOINT_MAGIC 0x54504b4347495a4cUL   //"LZIGCKPT"
+#define CHECKPOINT_VERSION 1
+
+//Placed at the beginning of every checkpoint file. Entries (a LazyGaspiRowData tag followed by the row) come right after it.
+struct CheckpointHeader{
+    uint64_t magic;
+    uint64_t version;
+    uint64_t n;
+    uint64_t rank;
+    uint64_t table_amount;
+    uint64_t table_size;
+    uint64_t row_size;
+    uint64_t block_size;
+    uint64_t row_amount;
+    //The age of the rank when the checkpoint was taken.
+    uint64_t age;
+};
+
+//A changed row, copied out of the rows segment, waiting to be written by the checkpoint thread.
+struct CheckpointEntry{
+    gaspi_offset_t index;
+    size_t offset;
+};
+
+//Only one checkpoint is written at a time, even with several instances. The state below is shared by all instances, and only 
+//used while holding checkpoint_mutex.
+static std::mutex checkpoint_mutex;
+static std::thread checkpoint_thread;
+static gaspi_return_t checkpoint_result = GASPI_SUCCESS;
+//The file of the last checkpoint of an instance and the fingerprints of its entries. A checkpoint to another file writes all 
+//rows.
+struct CheckpointFile{
+    std::string path;
+    //Per row: the fingerprint of its entry in the file, or empty if the file does not hold any entries yet.
+    std::vector<uint64_t> fingerprints;
+};
+static PerInstance<CheckpointFile> checkpoint_file;
+//The file of the instance whose checkpoint is being written.
+static CheckpointFile* checkpoint_writing = nullptr;
+static std::vector<CheckpointEntry> checkpoint_entries;
+static std::vector<char> checkpoint_buffer;
+static CheckpointHeader checkpoint_header;
+
+static inline std::string get_checkpoint_filename(const char* path, gaspi_rank_t rank){
+    return std::string(path) + '.' + std::to_string(rank);
+}
+
+static inline size_t get_checkpoint_entry_size(const LazyGaspiProcessInfo* info){
+    return sizeof(LazyGaspiRowData) + info->row_size;
+}
+
+/** Fingerprint of a checkpoint entry (tag and row). Rows are written by other ranks with one-sided transfers and can be written 
+ *  again without changing their age, so an entry is only known to be unchanged if its fingerprint is. */
+static uint64_t get_entry_fingerprint(const char* entry, size_t size){
+    uint64_t hash = 0xcbf29ce484222325UL, word;
+    for(; size >= sizeof(word); entry += sizeof(word), size -= sizeof(word)){
+        memcpy(&word, entry, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3UL;
+        hash ^= hash >> 32;
+    }
+    word = 0;
+    memcpy(&word, entry, size);
+    return (hash ^ word ^ size) * 0x100000001b3UL;
+}
+
+static bool write_all(int fd, const char* data, size_t size, off_t offset){
+    while(size){
+        auto written = pwrite(fd, data, size, offset);
+        if(written < 0) return false;
+        data += written; offset += written; size -= written;
+    }
+    return true;
+}
+
+/* Writes the staged entries and the header to the checkpoint file. Runs on the checkpoint thread. */
+static void write_checkpoint(std::string filename, size_t entry_size){
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+    if(fd < 0) { checkpoint_result = GASPI_ERROR; return; }
+
+    bool ok = ftruncate(fd, sizeof(CheckpointHeader) + checkpoint_header.row_amount * entry_size) == 0;
+    for(auto it = checkpoint_entries.begin(); ok && it != checkpoint_entries.end(); it++)
+        ok = write_all(fd, checkpoint_buffer.data() + it->offset, entry_size, sizeof(CheckpointHeader) + it->index * entry_size);
+    //The header goes last, so that the age in it never refers to rows that were not written yet.
+    ok = ok && fsync(fd) == 0 && write_all(fd, (const char*)&checkpoint_header, sizeof(CheckpointHeader), 0) && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+
+    checkpoint_result = ok ? GASPI_SUCCESS : GASPI_ERROR;
+}
+
+/** Waits for the checkpoint being written, if any, and returns its result. The caller must hold checkpoint_mutex. */
+static gaspi_return_t wait_for_checkpoint(LazyGaspiProcessInfo* info){
+    (void)info;
+    if(checkpoint_thread.joinable()){
+        PRINT_DEBUG_INTERNAL("Waiting for checkpoint to " << checkpoint_writing->path << " to be written...");
+        checkpoint_thread.join();
+        checkpoint_entries.clear();
+        checkpoint_buffer.clear();
+        if(checkpoint_result != GASPI_SUCCESS){
+            PRINT_ON_ERROR("Failed to write checkpoint to " << get_checkpoint_filename(checkpoint_writing->path.c_str(), info->id));
+            //The file can no longer be trusted to hold the entries in CheckpointFile::fingerprints. Next checkpoint writes all rows.
+            checkpoint_writing->path.clear();
+        }
+    }
+    const auto r = checkpoint_result;
+    checkpoint_result = GASPI_SUCCESS;
+    return r;
+}
+
+gaspi_return_t lazygaspi_checkpoint_wait(){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    std::lock_guard<std::mutex> guard(checkpoint_mutex);
+    return wait_for_checkpoint(info);
+}
+
+gaspi_return_t lazygaspi_checkpoint(const char* path){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    #ifdef SAFETY_CHECKS
+    if(path == nullptr){
+        PRINT_ON_ERROR("Tried to checkpoint to nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    #endif
+
+    std::lock_guard<std::mutex> guard(checkpoint_mutex);
+    r = wait_for_checkpoint(info); ERROR_CHECK;
+
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
+    const auto entry_size = get_checkpoint_entry_size(info);
+
+    if(checkpoint_file->path != path){
+        PRINT_DEBUG_INTERNAL("Checkpointing all rows to new file " << get_checkpoint_filename(path, info->id) << "...");
+        checkpoint_file->path = path;
+        //All rows (even those never written) are written to the new file.
+        checkpoint_file->fingerprints.clear();
+    }
+    const bool all = checkpoint_file->fingerprints.empty();
+    checkpoint_file->fingerprints.resize(row_amount);
+
+    gaspi_pointer_t rows;
+    if(row_amount) { r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows); ERROR_CHECK; }
+
+    for(gaspi_offset_t i = 0; i < row_amount; i++){
+        auto tag = (RowTag*)((char*)rows + rows_tag_offset(info, i));
+
+        #ifdef LOCKED_OPERATIONS
+            r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id); ERROR_CHECK;
+        #endif
+
+        //The row is staged first and dropped again if the file already holds the same entry. The fingerprint is taken from the
+        //copy, so that a write that lands meanwhile is caught by the next checkpoint.
+        const auto offset = checkpoint_buffer.size();
+        checkpoint_buffer.resize(offset + entry_size);
+        LazyGaspiRowData data = *tag;
+        memcpy(checkpoint_buffer.data() + offset, &data, sizeof(LazyGaspiRowData));
+        memcpy(checkpoint_buffer.data() + offset + sizeof(LazyGaspiRowData), (char*)rows + rows_data_offset(info, i),
+               info->row_size);
+
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id); ERROR_CHECK;
+        #endif
+
+        const auto fingerprint = get_entry_fingerprint(checkpoint_buffer.data() + offset, entry_size);
+        if(!all && fingerprint == checkpoint_file->fingerprints[i]){
+            checkpoint_buffer.resize(offset);
+            continue;
+        }
+        checkpoint_entries.push_back({i, offset});
+        checkpoint_file->fingerprints[i] = fingerprint;
+    }
+
+    PRINT_DEBUG_INTERNAL("Checkpointing " << checkpoint_entries.size() << " of " << row_amount << " rows at age " << info->age
+                         << " to " << get_checkpoint_filename(path, info->id) << "...");
+
+    checkpoint_header = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION, info->n, info->id, info->table_amount, info->table_size,
+                          info->row_size, info->shardOpts.block_size, row_amount, info->age };
+    checkpoint_writing = &*checkpoint_file;
+    checkpoint_thread = std::thread(write_checkpoint, get_checkpoint_filename(path, info->id), entry_size);
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_restore(const char* path){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    #ifdef SAFETY_CHECKS
+    if(path == nullptr){
+        PRINT_ON_ERROR("Tried to restore from nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    #endif
+
+    const auto filename = get_checkpoint_filename(path, info->id);
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
+    const auto entry_size = get_checkpoint_entry_size(info);
+    const auto file_size = sizeof(CheckpointHeader) + row_amount * entry_size;
+
+    PRINT_DEBUG_INTERNAL("Restoring " << row_amount << " rows from " << filename << "...");
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0){
+        PRINT_ON_ERROR("Failed to open " << filename);
+        return GASPI_ERROR;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size != file_size){
+        PRINT_ON_ERROR(filename << " does not have the size of a checkpoint of the current rank (" << file_size << " bytes).");
+        close(fd);
+        return GASPI_ERR_INV_NUM;
+    }
+    auto file = (const char*)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED){
+        PRINT_ON_ERROR("Failed to map " << filename);
+        return GASPI_ERROR;
+    }
+
+    auto header = (const CheckpointHeader*)file;
+    if(header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION || header->n != info->n ||
+       header->rank != info->id || header->table_amount != info->table_amount || header->table_size != info->table_size ||
+       header->row_size != info->row_size || header->block_size != info->shardOpts.block_size ||
+       header->row_amount != row_amount){
+        PRINT_ON_ERROR(filename << " is not a checkpoint of the current rank with the current parameters.");
+        munmap((void*)file, file_size);
+        return GASPI_ERR_INV_NUM;
+    }
+
+    gaspi_pointer_t rows;
+    if(row_amount) { r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows); ERROR_CHECK; }
+    checkpoint_file->fingerprints.resize(row_amount);
+
+    for(gaspi_offset_t i = 0; i < row_amount; i++){
+        auto entry = file + sizeof(CheckpointHeader) + i * entry_size;
+        LazyGaspiRowData data;
+        memcpy(&data, entry, sizeof(LazyGaspiRowData));
+        auto tag = RowTag(data.age, data.row_id, data.table_id);
+        memcpy((char*)rows + rows_tag_offset(info, i), &tag, sizeof(RowTag));
+        memcpy((char*)rows + rows_data_offset(info, i), entry + sizeof(LazyGaspiRowData), info->row_size);
+        set_modified_age(info, rows, i, data.age);
+        checkpoint_file->fingerprints[i] = get_entry_fingerprint(entry, entry_size);
+    }
+
+    info->age = header->age;
+    info->write_age = header->age;
+    checkpoint_file->path = path;
+    munmap((void*)file, file_size);
+
+    r = publish_clock(info, info->age); ERROR_CHECK;
+
+    PRINT_DEBUG_INTERNAL("Restored rows. Age is now " << info->age);
+    return GASPI_BARRIER;
+}
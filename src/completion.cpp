@@ -0,0 +1,121 @@
+#include "lazygaspi_hs.h"
+#include "utils.h"
+#include "gaspi_utils.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Per queue: the last ticket taken, and the last ticket known to be complete. Queues are shared by all instances and threads.
+static std::unique_ptr<std::atomic<Ticket>[]> posted_tickets, completed_tickets;
+static std::once_flag queue_counters_flag;
+static gaspi_return_t queue_counters_status = GASPI_SUCCESS;
+
+struct InstanceTickets{
+    //Per cache slot: the ticket of the last transfer that used the slot as its source.
+    std::vector<Ticket> slots;
+    //Per entry of the staging region: the ticket of the last transfer that used the entry as its source.
+    std::vector<Ticket> staging;
+    //The ticket of the last transfer that used LazyGaspiProcessInfo::communicator as its source (always on queue 0).
+    Ticket communicator = 0;
+};
+static PerInstance<InstanceTickets> tickets;
+
+PerInstance<std::mutex> staging_mutex;
+
+//One bit per range of read notifications, set while a read holds it. Notifications are per segment, so ranges are shared by all
+//instances.
+static std::atomic<unsigned long long> held_read_ranges(0);
+static_assert(NOTIF_ROWS_READ_RANGES <= sizeof(unsigned long long) * 8, "Every range of read notifications needs a bit.");
+
+static gaspi_return_t init_queue_counters(){
+    std::call_once(queue_counters_flag, []{
+        gaspi_number_t queue_amount;
+        queue_counters_status = gaspi_queue_num(&queue_amount);
+        if(queue_counters_status != GASPI_SUCCESS) return;
+        posted_tickets.reset(new std::atomic<Ticket>[queue_amount]);
+        completed_tickets.reset(new std::atomic<Ticket>[queue_amount]);
+        for(gaspi_number_t q = 0; q < queue_amount; q++) posted_tickets[q] = completed_tickets[q] = 0;
+    });
+    return queue_counters_status;
+}
+
+Ticket take_ticket(gaspi_queue_id_t q){
+    if(init_queue_counters() != GASPI_SUCCESS) return 0;
+    return posted_tickets[q].fetch_add(1) + 1;
+}
+
+gaspi_return_t wait_for_queue(gaspi_queue_id_t q){
+    auto r = init_queue_counters(); ERROR_CHECK_COUT;
+    //Every ticket up to the target was taken after its transfer was posted, so the wait below covers all of them.
+    const Ticket target = posted_tickets[q];
+    TRACE_SCOPE(TRACE_WAIT);
+    r = gaspi_wait(q, GASPI_BLOCK); ERROR_CHECK_COUT;
+    auto completed = completed_tickets[q].load();
+    while(completed < target && !completed_tickets[q].compare_exchange_weak(completed, target));
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t wait_for_ticket(Ticket ticket, gaspi_queue_id_t q){
+    if(ticket == 0 || completed_tickets[q] >= ticket) return GASPI_SUCCESS;
+    return wait_for_queue(q);
+}
+
+void set_slot_ticket(const LazyGaspiProcessInfo* info, gaspi_offset_t slot, Ticket ticket){
+    if(tickets->slots.size() != info->cacheOpts.size) tickets->slots.assign(info->cacheOpts.size, 0);
+    tickets->slots[slot] = ticket;
+}
+
+gaspi_return_t wait_for_slot(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    if(tickets->slots.size() != info->cacheOpts.size) return GASPI_SUCCESS;
+    return wait_for_ticket(tickets->slots[slot]);
+}
+
+void set_staging_ticket(const LazyGaspiProcessInfo* info, gaspi_offset_t k, Ticket ticket){
+    if(tickets->staging.size() != get_staging_capacity(info)) tickets->staging.assign(get_staging_capacity(info), 0);
+    tickets->staging[k] = ticket;
+}
+
+gaspi_return_t wait_for_staging(const LazyGaspiProcessInfo* info, gaspi_offset_t k){
+    (void)info;
+    if(k >= tickets->staging.size()) return GASPI_SUCCESS;
+    return wait_for_ticket(tickets->staging[k]);
+}
+
+gaspi_return_t wait_for_staging(const LazyGaspiProcessInfo* info){
+    (void)info;
+    Ticket last = 0;
+    for(auto ticket : tickets->staging) if(ticket > last) last = ticket;
+    return wait_for_ticket(last);
+}
+
+gaspi_return_t set_communicator(LazyGaspiProcessInfo* info, lazygaspi_age_t value){
+    auto r = wait_for_ticket(tickets->communicator); ERROR_CHECK;
+    info->communicator = value;
+    return GASPI_SUCCESS;
+}
+
+void set_communicator_ticket(Ticket ticket){
+    tickets->communicator = ticket;
+}
+
+gaspi_notification_id_t take_read_notifications(){
+    constexpr unsigned long long all = NOTIF_ROWS_READ_RANGES == 64 ? ~0ull : (1ull << NOTIF_ROWS_READ_RANGES) - 1;
+    auto held = held_read_ranges.load(std::memory_order_relaxed);
+    while(true){
+        if((held & all) == all){
+            std::this_thread::yield();
+            held = held_read_ranges.load(std::memory_order_relaxed);
+            continue;
+        }
+        const auto range = __builtin_ctzll(~held);
+        if(held_read_ranges.compare_exchange_weak(held, held | 1ull << range, std::memory_order_acquire, std::memory_order_relaxed))
+            return NOTIF_ID_ROWS_READ + 2 * range;
+    }
+}
+
+void release_read_notifications(gaspi_notification_id_t first){
+    held_read_ranges.fetch_and(~(1ull << (first - NOTIF_ID_ROWS_READ) / 2), std::memory_order_release);
+}
@@ -0,0 +1,78 @@
+#ifdef EVENT_LOG
+
+#include "event_log.h"
+#include "gaspi_utils.h"
+
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static_assert((EVENT_LOG_BUFFER_SIZE & (EVENT_LOG_BUFFER_SIZE - 1)) == 0, "EVENT_LOG_BUFFER_SIZE must be a power of 2.");
+
+static LogRecord* log_buffer = nullptr;
+static std::atomic<uint64_t> log_head(0);
+static gaspi_rank_t log_rank;
+
+gaspi_return_t event_log_init(gaspi_rank_t rank){
+    log_rank = rank;
+    log_buffer = new (std::nothrow) LogRecord[EVENT_LOG_BUFFER_SIZE];
+    if(log_buffer == nullptr){
+        PRINT_ON_ERROR_COUT("Failed to allocate event log buffer.");
+        return GASPI_ERR_MEMALLOC;
+    }
+    log_head = 0;
+    return GASPI_SUCCESS;
+}
+
+void event_log_record(LogEventType event, lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_rank_t rank, lazygaspi_age_t age){
+    if(log_buffer == nullptr) return;
+    auto& record = log_buffer[log_head.fetch_add(1, std::memory_order_relaxed) & (EVENT_LOG_BUFFER_SIZE - 1)];
+    record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count();
+    record.row_id = row_id;
+    record.table_id = table_id;
+    record.age = age;
+    record.rank = rank;
+    record.event = event;
+}
+
+gaspi_return_t event_log_dump(){
+    if(log_buffer == nullptr) return GASPI_SUCCESS;
+
+    char name[64];
+    snprintf(name, sizeof(name), "lazygaspi_log_%u.bin", (unsigned int)log_rank);
+    auto file = fopen(name, "wb");
+    if(file == nullptr){
+        PRINT_ON_ERROR_COUT("Failed to open " << name);
+        return GASPI_ERROR;
+    }
+
+    const uint64_t head = log_head;
+    const uint64_t first = head > EVENT_LOG_BUFFER_SIZE ? head - EVENT_LOG_BUFFER_SIZE : 0;
+    LogFileHeader header = {};
+    memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(LogRecord);
+    header.rank = log_rank;
+    header.count = head - first;
+    header.dropped = first;
+
+    //The oldest record is not necessarily at the start of the buffer, so the records are written in up to two runs.
+    const auto begin = first & (EVENT_LOG_BUFFER_SIZE - 1);
+    const auto run = header.count < EVENT_LOG_BUFFER_SIZE - begin ? header.count : EVENT_LOG_BUFFER_SIZE - begin;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(log_buffer + begin, sizeof(LogRecord), run, file) == run &&
+              fwrite(log_buffer, sizeof(LogRecord), header.count - run, file) == header.count - run;
+    ok = fclose(file) == 0 && ok;
+
+    delete[] log_buffer;
+    log_buffer = nullptr;
+    if(!ok){
+        PRINT_ON_ERROR_COUT("Failed to write " << name);
+        return GASPI_ERROR;
+    }
+    return GASPI_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/** Event log for LazyGASPI. Only recorded with EVENT_LOG (see configure.sh).
+ *  Every logged event is stored as a fixed-size binary record in a per-rank ring buffer, without any formatting, so that the
+ *  log can stay enabled in production runs (unlike DEBUG_INTERNAL). `lazygaspi_term` writes the buffer to
+ *  `lazygaspi_log_<rank>.bin`, which the `log_decode` tool renders as text. When the buffer is full, the oldest records are
+ *  overwritten. */
+
+#ifndef __H_EVENT_LOG
+#define __H_EVENT_LOG
+
+#include <GASPI.h>
+#include <cstdint>
+
+#include "lazygaspi_hs.h"
+
+//Amount of records kept by the ring buffer. Must be a power of 2.
+#ifndef EVENT_LOG_BUFFER_SIZE
+#define EVENT_LOG_BUFFER_SIZE (1 << 16)
+#endif
+
+//First bytes of a log file. The last one is the version of the format.
+#define EVENT_LOG_MAGIC "LGHSLOG1"
+
+//The meaning of the rank and age of a record depends on its event:
+// read_hit, read_miss  - The rank that stores the row and the age of the returned row.
+// remote_read          - The rank that stores the row and the minimum age of the read.
+// push_wait            - The rank that was asked to push the row and the minimum age of the request.
+// push_timeout         - Same as push_wait.
+// write                - The rank that stores the row and the age it was written with.
+// prefetch             - The rank that was asked to push the row and the minimum age of the request.
+// prefetch_push        - The rank the row was pushed to and the age of the pushed row.
+// clock                - The current rank and its new age. The row and table ID's are 0.
+enum LogEventType : uint8_t {
+    LOG_READ_HIT, LOG_READ_MISS, LOG_REMOTE_READ, LOG_PUSH_WAIT, LOG_PUSH_TIMEOUT, LOG_WRITE, LOG_PREFETCH, LOG_PREFETCH_PUSH,
+    LOG_CLOCK, LOG_EVENT_TYPE_AMOUNT
+};
+
+static const char* const log_event_names[LOG_EVENT_TYPE_AMOUNT] = {
+    "read_hit", "read_miss", "remote_read", "push_wait", "push_timeout", "write", "prefetch", "prefetch_push", "clock"
+};
+
+//Fields have fixed sizes, so that logs can be decoded on another machine.
+struct LogRecord{
+    //Nanoseconds since epoch.
+    uint64_t timestamp;
+    uint64_t row_id, table_id;
+    uint64_t age;
+    uint16_t rank;
+    uint8_t event;
+    uint8_t padding[5];
+};
+static_assert(sizeof(LogRecord) == 40, "LogRecord must not depend on the platform's padding.");
+
+//Header of a log file, followed by `count` records from the oldest to the newest.
+struct LogFileHeader{
+    char magic[8];
+    uint32_t record_size;
+    //The rank that wrote the log.
+    uint16_t rank;
+    uint16_t padding;
+    uint64_t count;
+    //The amount of records that were overwritten before the log was written.
+    uint64_t dropped;
+};
+static_assert(sizeof(LogFileHeader) == 32, "LogFileHeader must not depend on the platform's padding.");
+
+/** Allocates the ring buffer of the current rank. Called by `lazygaspi_init`. */
+gaspi_return_t event_log_init(gaspi_rank_t rank);
+
+/** Stores a record in the ring buffer. Lock-free and safe to call from multiple threads. */
+void event_log_record(LogEventType event, lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_rank_t rank, lazygaspi_age_t age);
+
+/** Writes the ring buffer to `lazygaspi_log_<rank>.bin` and frees it. Called by `lazygaspi_term`. */
+gaspi_return_t event_log_dump();
+
+#endif
@@ -190,26 +190,35 @@ typedef gaspi_size_t (*SizeReductor)(gaspi_size_t size, void* data);
 static gaspi_return_t gaspi_malloc_amap(gaspi_segment_id_t seg, gaspi_size_t size, SizeReductor red, gaspi_size_t margin, 
                                         gaspi_size_t* allocated, gaspi_pointer_t* ptr = nullptr, void* data = nullptr, 
                                         gaspi_alloc_policy_flags policy = GASPI_MEM_UNINITIALIZED){
-    auto r = gaspi_segment_create_noblock(seg, size, policy);
-    while(r == GASPI_ERR_MEMALLOC || r == GASPI_ERROR) {
+    gaspi_number_t max;
+    auto r = gaspi_segment_max(&max); ERROR_CHECK_COUT;
+
+    while(true){
+        r = gaspi_segment_alloc(seg, size, policy);
+        if(r == GASPI_SUCCESS){
+            if(margin == 0) break;
+            //The margin is only probed locally, so it is never registered with other ranks.
+            r = gaspi_segment_alloc(max - 1, margin, GASPI_MEM_UNINITIALIZED);
+            if(r == GASPI_SUCCESS){
+                r = gaspi_segment_delete(max - 1); ERROR_CHECK_COUT;
+                break;
+            }
+            auto r_delete = gaspi_segment_delete(seg);
+            if(r_delete != GASPI_SUCCESS) { PRINT_ON_ERROR_COUT(r_delete); return r_delete; }
+        }
+        if(r != GASPI_ERR_MEMALLOC && r != GASPI_ERROR) { PRINT_ON_ERROR_COUT(r); return r; }
+
         size = red(size, data);
         if(size == 0){
             PRINT_ON_ERROR_COUT("Tried to allocate segment but size was reduced to 0.");
             return GASPI_ERR_MEMALLOC; 
         }
-
-        r = gaspi_segment_create_noblock(seg, size, policy);
-        if(margin != 0 && r == GASPI_SUCCESS){
-            gaspi_number_t max;
-            r = gaspi_segment_max(&max);
-            ERROR_CHECK_COUT;
-            r = gaspi_segment_create_noblock(max - 1, margin);
-            ERROR_CHECK_COUT;
-            r = gaspi_segment_delete(max - 1);
-            ERROR_CHECK_COUT;
-        }
     }
-    ERROR_CHECK_COUT;
+
+    gaspi_rank_t n; 
+    r = gaspi_proc_num(&n); ERROR_CHECK_COUT;
+    for(gaspi_rank_t i = 0; i < n; i++) { r = gaspi_segment_register(seg, i, GASPI_BLOCK); ERROR_CHECK_COUT; }
+
     *allocated = size;
     return ptr ? gaspi_segment_ptr(seg, ptr) : GASPI_SUCCESS;
 }
@@ -325,6 +334,48 @@ static inline gaspi_return_t readwait(gaspi_segment_id_t from, gaspi_segment_id_
     return gaspi_wait(q, GASPI_BLOCK);
 }
 
+/** Reads from one segment to another, and sets a notification of the `to` segment once the data has arrived. Does not wait for 
+ *  the queue (unless it is full).
+ * 
+ *  Parameters are the same as for `read`, and:
+ *  id - The ID of the notification of the local `to` segment.
+ * 
+ *  Returns:
+ *  GASPI_SUCCESS on success, GASPI_ERROR (or another error code) on error, GASPI_TIMEOUT on timeout.
+ */
+static gaspi_return_t readnotify(gaspi_segment_id_t from, gaspi_segment_id_t to, gaspi_offset_t offset_from, 
+                                 gaspi_offset_t offset_to, gaspi_size_t size, gaspi_rank_t rank, gaspi_notification_id_t id,
+                                 gaspi_timeout_t timeout = GASPI_BLOCK, gaspi_queue_id_t q = 0){
+    auto r = gaspi_read_notify(to, offset_to, rank, from, offset_from, size, id, q, timeout);
+    while(r == GASPI_QUEUE_FULL){
+        r = gaspi_wait(q, GASPI_BLOCK); ERROR_CHECK_COUT;
+        r = gaspi_read_notify(to, offset_to, rank, from, offset_from, size, id, q, timeout);
+    }
+    ERROR_CHECK_COUT;
+    return GASPI_SUCCESS;
+}
+
+/** Waits for all notifications from `begin` to `begin + amount - 1` of a segment to be set, and resets them. */
+static gaspi_return_t wait_for_notifications(gaspi_segment_id_t seg, gaspi_notification_id_t begin, gaspi_number_t amount, 
+                                             gaspi_timeout_t timeout = GASPI_BLOCK){
+    gaspi_notification_id_t first;
+    gaspi_notification_t val;
+    for(auto id = begin; id < begin + amount; id++){
+        auto r = gaspi_notify_waitsome(seg, id, 1, &first, timeout); ERROR_CHECK_COUT;
+        r = gaspi_notify_reset(seg, id, &val); ERROR_CHECK_COUT;
+    }
+    return GASPI_SUCCESS;
+}
+
+/** Like `readwait`, but only waits for this read to complete instead of for everything posted to the queue. */
+static inline gaspi_return_t readwait_notify(gaspi_segment_id_t from, gaspi_segment_id_t to, gaspi_offset_t offset_from, 
+                                             gaspi_offset_t offset_to, gaspi_size_t size, gaspi_rank_t rank, 
+                                             gaspi_notification_id_t id, gaspi_timeout_t timeout = GASPI_BLOCK, 
+                                             gaspi_queue_id_t q = 0){
+    auto r = readnotify(from, to, offset_from, offset_to, size, rank, id, timeout, q); ERROR_CHECK_COUT;
+    return wait_for_notifications(to, id, 1);
+}
+
 /**Writes from one segment to another. 
  * Waits for the given queue to free up if it is full.
  * Make sure data is not changed before write request is fulfilled (by using gaspi_wait).
@@ -2,6 +2,19 @@
 #include "gaspi_utils.h"
 #include "utils.h"
 
+thread_local lazygaspi_instance_t lazygaspi_current_instance = 0;
+
+gaspi_return_t lazygaspi_use_instance(lazygaspi_instance_t instance){
+    #ifdef SAFETY_CHECKS
+    if(instance % LAZYGASPI_INSTANCE_SEGMENTS){
+        PRINT_ON_ERROR_COUT("Instance " << (unsigned int)instance << " is not a multiple of " << LAZYGASPI_INSTANCE_SEGMENTS << '.');
+        return GASPI_ERR_INV_SEG;
+    }
+    #endif
+    lazygaspi_current_instance = instance;
+    return GASPI_SUCCESS;
+}
+
 gaspi_return_t lazygaspi_get_info(LazyGaspiProcessInfo** info){
     #ifdef SAFETY_CHECKS
     if(info == nullptr){
@@ -33,23 +46,53 @@ gaspi_return_t lazygaspi_set_max_threads(unsigned int max_threads){
 gaspi_return_t lazygaspi_clock(){
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+    TRACE_SCOPE(TRACE_CLOCK);
+    //Kept rows were written with the current age, so they must reach their ranks before other ranks see the next one.
+    r = lazygaspi_flush(); ERROR_CHECK;
+    //Modification ages are sent from LazyGaspiProcessInfo::age (see mark_modified), so they must arrive before it changes.
+    r = wait_for_queue(0); ERROR_CHECK;
     info->age++;
-    PRINT_DEBUG_INTERNAL("Increased age to " << info->age);
+    PRINT_DEBUG_INTERNAL("Increased age to " << info->age << ". Publishing it to all ranks...");
+    r = publish_clock(info, info->age); ERROR_CHECK;
+    LOG_EVENT(LOG_CLOCK, 0, 0, info->id, info->age);
+    if(info->auto_prefetch) return prefetch_read_pattern(info);
     return GASPI_SUCCESS;
 }
 
 gaspi_return_t lazygaspi_term(){
+    std::lock_guard<std::mutex> guard(instance_mutex);
+
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
 
     PRINT_DEBUG_INTERNAL("Started to terminate LazyGASPI for current process. Waiting for outstanding requests in queue 0...");
 
-    r = gaspi_wait(0, GASPI_BLOCK); ERROR_CHECK;
-    r = GASPI_BARRIER;              ERROR_CHECK;
+    r = lazygaspi_flush();              ERROR_CHECK;
+    r = wait_for_queue(0);              ERROR_CHECK;
+    r = lazygaspi_checkpoint_wait();    ERROR_CHECK;
+    r = GASPI_BARRIER;                  ERROR_CHECK;
+    r = node_cache_term(info);          ERROR_CHECK;
 
     PRINT_DEBUG_INTERNAL("Terminating...\n\n");
 
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
     if(info->out && info->out != &std::cout) delete info->out;
+    free(info->histograms);
+    info->histograms = nullptr;
+
+    //Other instances still use GASPI, so only the segments of this one are deleted.
+    if(--instance_amount > 0){
+        if(row_amount) { r = gaspi_segment_delete(LAZYGASPI_ID_ROWS); ERROR_CHECK_COUT; }
+        r = gaspi_segment_delete(LAZYGASPI_ID_CACHE); ERROR_CHECK_COUT;
+        return gaspi_segment_delete(LAZYGASPI_ID_INFO);
+    }
+
+    #ifdef TRACE
+    r = trace_dump(); ERROR_CHECK_COUT;
+    #endif
+    #ifdef EVENT_LOG
+    r = event_log_dump(); ERROR_CHECK_COUT;
+    #endif
     
     #ifdef WITH_MPI
     r = gaspi_proc_term(GASPI_BLOCK); ERROR_CHECK_COUT;
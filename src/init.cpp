@@ -6,22 +6,31 @@
 #include "gaspi_utils.h"
 #include "utils.h"
 
+unsigned int instance_amount = 0;
+std::mutex instance_mutex;
+
 /* Allocates: rows; cache. Sets n and id for info. Hits barrier for all. */
 gaspi_return_t allocate_segments(LazyGaspiProcessInfo* info);
 
+/* Allocates as many cache rows as memory allows on all ranks and sets the cache size of info. */
+gaspi_return_t allocate_cache_amap(LazyGaspiProcessInfo* info);
+
 gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_size, gaspi_size_t row_size, 
                               ShardingOptions shard_options, CachingOptions cache_options, OutputCreator outputCreator,
                               SizeDeterminer det_amount, void* data_amount, SizeDeterminer det_tablesize, void* data_tablesize, 
                               SizeDeterminer det_rowsize, void* data_rowsize){
+    std::lock_guard<std::mutex> guard(instance_mutex);
 
     #ifdef WITH_MPI
     PRINT_DEBUG_INTERNAL_COUT("Initializing MPI...");
     int mpi_rank, mpi_rank_amount;
     {
-        int provided; 
-        auto ret = MPI_Init_thread(0, 0, MPI_THREAD_SERIALIZED, &provided); ERROR_MPI_CHECK_COUT("Failed to init");
-        if(provided != MPI_THREAD_SERIALIZED) ERROR_MPI_CHECK_COUT("Tried to initialize with " << (int)MPI_THREAD_SERIALIZED 
-                                                                  << " but " << provided << " was provided.");
+        int provided, ret; 
+        if(instance_amount == 0){
+            ret = MPI_Init_thread(0, 0, MPI_THREAD_SERIALIZED, &provided); ERROR_MPI_CHECK_COUT("Failed to init");
+            if(provided != MPI_THREAD_SERIALIZED) ERROR_MPI_CHECK_COUT("Tried to initialize with " << (int)MPI_THREAD_SERIALIZED 
+                                                                      << " but " << provided << " was provided.");
+        }
         ret = MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank); ERROR_MPI_CHECK_COUT("Failed to get rank");
         ret = MPI_Comm_size(MPI_COMM_WORLD, &mpi_rank_amount); ERROR_MPI_CHECK_COUT("Failed to get rank amount");
         PRINT_DEBUG_INTERNAL_COUT("MPI determined this to be rank " << mpi_rank << ", with " << mpi_rank_amount << " total.");
@@ -29,17 +38,47 @@ gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_
     }
     #endif
 
-    PRINT_DEBUG_INTERNAL_COUT("Initializing LazyGASPI...");
+    PRINT_DEBUG_INTERNAL_COUT("Initializing LazyGASPI instance " << (unsigned int)lazygaspi_current_instance << "...");
 
-    auto r = gaspi_proc_init(GASPI_BLOCK); ERROR_CHECK_COUT;
+    //GASPI is shared by all instances.
+    gaspi_return_t r;
+    if(instance_amount == 0) { r = gaspi_proc_init(GASPI_BLOCK); ERROR_CHECK_COUT; }
 
+    #ifdef SAFETY_CHECKS
+    {
+        gaspi_number_t segment_max;
+        r = gaspi_segment_max(&segment_max); ERROR_CHECK_COUT;
+        if((gaspi_number_t)lazygaspi_current_instance + LAZYGASPI_INSTANCE_SEGMENTS > segment_max){
+            PRINT_ON_ERROR_COUT("Instance " << (unsigned int)lazygaspi_current_instance << " needs more than the " << segment_max
+                                << " segments GASPI supports.");
+            return GASPI_ERR_INV_SEG;
+        }
+        gaspi_pointer_t existing;
+        if(gaspi_segment_ptr(LAZYGASPI_ID_INFO, &existing) == GASPI_SUCCESS){
+            PRINT_ON_ERROR_COUT("Instance " << (unsigned int)lazygaspi_current_instance << " was already initialized.");
+            return GASPI_ERR_INV_SEG;
+        }
+    }
+    #endif
+
+    gaspi_rank_t n;
+    r = gaspi_proc_num(&n); ERROR_CHECK_COUT;
+
+    //The info segment is followed by the clock vector. See utils.h.
     LazyGaspiProcessInfo* info;
-    r = gaspi_malloc_noblock(LAZYGASPI_ID_INFO, sizeof(LazyGaspiProcessInfo), &info, GASPI_MEM_INITIALIZED); 
+    r = gaspi_malloc_noblock(LAZYGASPI_ID_INFO, get_info_segment_size(n), &info, GASPI_MEM_INITIALIZED); 
     ERROR_CHECK_COUT;
 
     r = gaspi_proc_num(&(info->n)); ERROR_CHECK_COUT;
     r = gaspi_proc_rank(&(info->id)); ERROR_CHECK_COUT;
 
+    #ifdef TRACE
+    if(instance_amount == 0) { r = trace_init(info->id); ERROR_CHECK_COUT; }
+    #endif
+    #ifdef EVENT_LOG
+    if(instance_amount == 0) { r = event_log_init(info->id); ERROR_CHECK_COUT; }
+    #endif
+
     #if defined WITH_MPI && defined SAFETY_CHECKS
     if(mpi_rank != info->id) {
         PRINT_ON_ERROR_COUT("MPI and GASPI ranks did not match!");
@@ -76,8 +115,8 @@ gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_
     }
 
     if(shard_options.block_size == 0) shard_options.block_size = table_size;
-    if(cache_options.hash == nullptr || cache_options.size == 0) 
-        cache_options = CachingOptions(LAZYGASPI_HS_HASH_ROW, table_size);
+    if(cache_options.hash == nullptr) cache_options.hash = LAZYGASPI_HS_HASH_ROW;
+    if(cache_options.size == 0) cache_options.size = table_size;
 
     PRINT_DEBUG_INTERNAL("Table amount: " << table_amount << " | Table size: " << table_size << " | Row size: " << row_size);
 
@@ -87,33 +126,91 @@ gaspi_return_t lazygaspi_init(lazygaspi_id_t table_amount, lazygaspi_id_t table_
     info->table_amount = table_amount;
     info->table_size = table_size;
     info->offset_slack = true;
+    info->wait_for_push = false;
+    info->push_timeout = 10;
+    info->write_back = false;
+    info->auto_prefetch = false;
+    info->auto_prefetch_history = 2;
+    info->write_age = 0;
+    info->rows_capacity = get_row_amount(table_size, table_amount, info->n, 0, shard_options);
+
+    #ifdef SOA_LAYOUT
+    if(table_size > UINT32_MAX || table_amount > UINT32_MAX){
+        PRINT_ON_ERROR("Compact row tags (SOA_LAYOUT) only support 32-bit row and table ID's.");
+        return GASPI_ERR_INV_NUM;
+    }
+    #endif
 
     r = lazygaspi_set_max_threads(1); ERROR_CHECK;
 
+    #ifdef READ_STATS
+    info->histograms = (LazyGaspiReadHistogram*)calloc(table_amount, sizeof(LazyGaspiReadHistogram));
+    if(info->histograms == nullptr){
+        PRINT_ON_ERROR("Failed to allocate read histograms.");
+        return GASPI_ERR_MEMALLOC;
+    }
+    #endif
+
     r = allocate_segments(info); ERROR_CHECK;
+    r = node_cache_init(info); ERROR_CHECK;
 
+    instance_amount++;
     return GASPI_SUCCESS;
 }
 
 gaspi_return_t allocate_segments(LazyGaspiProcessInfo* info){
     auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
-    auto rows_table_size = ROW_SIZE_IN_TABLE_WITH_LOCK * row_amount;
-    auto cache_size = ROW_SIZE_IN_CACHE_WITH_LOCK * info->cacheOpts.size;
+    auto rows_table_size = get_rows_segment_size(info, row_amount);
+    const bool auto_cache = info->cacheOpts.size == LAZYGASPI_CACHE_SIZE_AUTO;
+    auto cache_size = auto_cache ? 0 : get_cache_segment_size(info);
 
-    PRINT_DEBUG_INTERNAL("Allocating cache with " << cache_size << " bytes (" << info->cacheOpts.size << " entries) and rows with "
-                         << rows_table_size << " bytes (" << row_amount << " entries)... Sharding options block size was "
+    PRINT_DEBUG_INTERNAL("Allocating cache with " << (auto_cache ? "as many bytes as possible" : std::to_string(cache_size) + " bytes")
+                         << " and rows with " << rows_table_size << " bytes (" << row_amount << " entries)... Sharding options block size was "
                          << info->shardOpts.block_size);
 
-    //An entry for this segment is a metadata tag, the row itself, and the pending prefetch requests (n slots).
+    //An entry for this segment is a metadata tag, the row itself, and the pending prefetch requests (n slots). See utils.h.
     gaspi_return_t r;
     if(row_amount){
         r = gaspi_segment_create_noblock(LAZYGASPI_ID_ROWS, rows_table_size, GASPI_MEM_INITIALIZED);
         ERROR_CHECK;
     }
 
-    //An entry for this segment is a metadata tag and the row itself.
-    r = gaspi_segment_create_noblock(LAZYGASPI_ID_CACHE, cache_size, GASPI_MEM_INITIALIZED);
+    //An entry for this segment is a metadata tag and the row itself. Entries are followed by the staging region. See utils.h.
+    if(auto_cache) r = allocate_cache_amap(info);
+    else r = gaspi_segment_create_noblock(LAZYGASPI_ID_CACHE, cache_size, GASPI_MEM_INITIALIZED);
     ERROR_CHECK;
 
     return GASPI_BARRIER;
-}
\ No newline at end of file
+}
+/* SizeReductor used with gaspi_malloc_amap: reduces the amount of cache rows and returns the resulting segment size. */
+static gaspi_size_t reduce_cache(gaspi_size_t, void* data){
+    auto info = (LazyGaspiProcessInfo*)data;
+    auto& opts = info->cacheOpts;
+    auto size = opts.reductor ? opts.reductor(opts.size, opts.reductor_data) : opts.size - opts.size / 8 - 1;
+    opts.size = size < opts.size ? size : (opts.size ? opts.size - 1 : 0);
+    PRINT_DEBUG_INTERNAL(" | Failed to allocate cache. Trying with " << opts.size << " entries...");
+    return opts.size ? get_cache_segment_size(info) : 0;
+}
+
+gaspi_return_t allocate_cache_amap(LazyGaspiProcessInfo* info){
+    //A bigger cache than all rows of all tables would never be filled.
+    info->cacheOpts.size = info->table_amount * info->table_size;
+    gaspi_size_t allocated;
+    auto r = gaspi_malloc_amap(LAZYGASPI_ID_CACHE, get_cache_segment_size(info), reduce_cache, info->cacheOpts.margin, 
+                               &allocated, nullptr, info, GASPI_MEM_INITIALIZED);
+    ERROR_CHECK;
+
+    //Rows are pushed to the slots computed with the pushing rank's cache size, so all ranks must use the same size.
+    gaspi_size_t size;
+    r = gaspi_allreduce(&(info->cacheOpts.size), &size, 1, GASPI_OP_MIN, GASPI_TYPE_ULONG, GASPI_GROUP_ALL, GASPI_BLOCK);
+    ERROR_CHECK;
+    PRINT_DEBUG_INTERNAL("Allocated cache with " << info->cacheOpts.size << " entries. Smallest cache among all ranks has "
+                         << size << " entries.");
+
+    if(size != info->cacheOpts.size){
+        info->cacheOpts.size = size;
+        r = gaspi_segment_delete(LAZYGASPI_ID_CACHE); ERROR_CHECK;
+        r = gaspi_segment_create_noblock(LAZYGASPI_ID_CACHE, get_cache_segment_size(info), GASPI_MEM_INITIALIZED); ERROR_CHECK;
+    }
+    return GASPI_SUCCESS;
+}
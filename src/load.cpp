@@ -0,0 +1,75 @@
+#include "lazygaspi_hs.h"
+#include "utils.h"
+#include "gaspi_utils.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+gaspi_return_t lazygaspi_load(const char* path, LazyGaspiLoadFormat format){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    #ifdef SAFETY_CHECKS
+    if(path == nullptr){
+        PRINT_ON_ERROR("Tried to load from nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(format != LAZYGASPI_LOAD_BY_TABLE && format != LAZYGASPI_LOAD_BY_ROW){
+        PRINT_ON_ERROR("Unknown load format " << (int)format << '.');
+        return GASPI_ERR_INV_NUM;
+    }
+    #endif
+
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
+    const auto file_size = info->table_amount * info->table_size * info->row_size;
+    //Rows with age 0 are never fresh (see get_min_age).
+    const auto age = info->age ? info->age : 1;
+
+    PRINT_DEBUG_INTERNAL("Loading " << row_amount << " rows from " << path << " with age " << age << "...");
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        PRINT_ON_ERROR("Failed to open " << path);
+        return GASPI_ERROR;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size != file_size){
+        PRINT_ON_ERROR(path << " does not have the size of all tables (" << file_size << " bytes).");
+        close(fd);
+        return GASPI_ERR_INV_NUM;
+    }
+    auto file = (const char*)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED){
+        PRINT_ON_ERROR("Failed to map " << path);
+        return GASPI_ERROR;
+    }
+    //Blocks of a rank are contiguous in a file ordered by table, so only they are paged in, in order.
+    if(format == LAZYGASPI_LOAD_BY_TABLE) madvise((void*)file, file_size, MADV_SEQUENTIAL);
+
+    gaspi_pointer_t rows;
+    if(row_amount) { r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows); ERROR_CHECK; }
+
+    lazygaspi_id_t row_id, table_id;
+    for(gaspi_offset_t i = 0; i < row_amount; i++){
+        std::tie(row_id, table_id) = get_row_id(info, info->id, i);
+        const auto position = format == LAZYGASPI_LOAD_BY_TABLE ? table_id * info->table_size + row_id
+                                                                : row_id * info->table_amount + table_id;
+        auto tag = RowTag(age, row_id, table_id);
+        memcpy((char*)rows + rows_tag_offset(info, i), &tag, sizeof(RowTag));
+        memcpy((char*)rows + rows_data_offset(info, i), file + position * info->row_size, info->row_size);
+        set_modified_age(info, rows, i, age);
+    }
+
+    munmap((void*)file, file_size);
+
+    //Loaded rows may be newer than the current age, which other ranks must know before reading them.
+    if(age > info->write_age) info->write_age = age;
+    if(age > get_clocks(info)[info->id]) { r = publish_clock(info, age); ERROR_CHECK; }
+
+    PRINT_DEBUG_INTERNAL("Loaded rows. Waiting for all ranks...");
+    return GASPI_BARRIER;
+}
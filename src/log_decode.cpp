@@ -0,0 +1,99 @@
+/** Renders the binary event logs written by LazyGASPI (see event_log.h) as text, one record per line. The records of all given
+ *  logs are merged by timestamp, so that the logs of all ranks can be read as a single timeline. */
+
+#include "event_log.h"
+#include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+void print_usage();
+
+struct DecodedRecord{
+    LogRecord record;
+    //The rank whose log contained the record.
+    uint16_t writer;
+};
+
+/** Appends the records of a log file to `records`. Returns false if the file could not be read or is not a log. */
+static bool read_log(const char* path, std::vector<DecodedRecord>& records){
+    auto file = fopen(path, "rb");
+    if(file == nullptr){
+        fprintf(stderr, "Failed to open %s.\n", path);
+        return false;
+    }
+
+    LogFileHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+       header.record_size != sizeof(LogRecord)){
+        fprintf(stderr, "%s is not an event log of this version.\n", path);
+        fclose(file);
+        return false;
+    }
+    if(header.dropped) fprintf(stderr, "%s: the %" PRIu64 " oldest records of rank %u were overwritten.\n", path, header.dropped,
+                               (unsigned int)header.rank);
+
+    const auto first = records.size();
+    records.resize(first + header.count);
+    for(auto i = first; i < records.size(); i++){
+        if(fread(&records[i].record, sizeof(LogRecord), 1, file) != 1){
+            fprintf(stderr, "%s was truncated after %zu records.\n", path, i - first);
+            records.resize(i);
+            break;
+        }
+        records[i].writer = header.rank;
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv){
+    int  ch;
+    bool relative = false;
+
+    while((ch = getopt(argc, argv, "hr")) != -1) {
+        switch(ch){
+            case 'r': relative = true; break;
+            case '?':
+            case ':':
+            default : print_usage(); exit(EXIT_FAILURE);
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+        }
+    }
+    if(optind == argc){
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    std::vector<DecodedRecord> records;
+    for(auto i = optind; i < argc; i++) if(!read_log(argv[i], records)) exit(EXIT_FAILURE);
+
+    std::stable_sort(records.begin(), records.end(), [](const DecodedRecord& a, const DecodedRecord& b){
+        return a.record.timestamp < b.record.timestamp;
+    });
+
+    const uint64_t origin = relative && !records.empty() ? records.front().record.timestamp : 0;
+    for(const auto& decoded : records){
+        const auto& record = decoded.record;
+        const auto time = record.timestamp - origin;
+        const char* name = record.event < LOG_EVENT_TYPE_AMOUNT ? log_event_names[record.event] : "unknown";
+        printf("%" PRIu64 ".%09" PRIu64 " [%u] %-13s row %" PRIu64 " table %" PRIu64 " rank %u age %" PRIu64 "\n",
+               time / 1000000000, time % 1000000000, (unsigned int)decoded.writer, name, record.row_id, record.table_id,
+               (unsigned int)record.rank, record.age);
+    }
+    return EXIT_SUCCESS;
+}
+
+void print_usage(){
+    std::cout << "Usage: log_decode [OPTIONS] <lazygaspi_log_<rank>.bin>...\n\n"
+              << "Parameters:\n"
+              << "  [-r]:   Timestamps are printed relative to the first record instead of since epoch.\n\n"
+              << "Each line is the time of a record in seconds, the rank whose log contained it, the event, and the row ID, "
+              << "table ID, rank and age of the record (see event_log.h).\n"
+              << std::endl;
+}
@@ -0,0 +1,292 @@
+#include "lazygaspi_hs.h"
+#include "gaspi_utils.h"
+#include "utils.h"
+#include <Eigen/Core>
+#include <Eigen/Sparse>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <unistd.h>
+#include <getopt.h>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace Eigen;
+
+//Tables of the factors. A row of either table is one factor of `rank` doubles.
+#define USER_TABLE 0
+#define ITEM_TABLE 1
+
+//Default values
+#define USERS 1024
+#define ITEMS 1024
+#define RANK 8
+#define DENSITY 0.05
+#define ITERATIONS 20
+#define LEARNING_RATE 0.05
+#define REGULARIZATION 0.02
+#define NOISE 0.01
+#define TARGET_RMSE 0.05
+#define SEED 42
+
+void print_usage();
+
+typedef SparseMatrix<double, RowMajor> UserRatings;
+typedef SparseMatrix<double, ColMajor> ItemRatings;
+typedef Map<VectorXd> Factor;
+
+struct MFParams{
+    lazygaspi_id_t users, items, block_size;
+    unsigned rank, iterations;
+    double density, learning_rate, regularization, noise, target;
+    std::vector<lazygaspi_slack_t> slacks;
+    unsigned long seed;
+};
+
+/** Traffic and work of one run, summed over all ranks by report. */
+struct MFCounters{
+    double reads, writes, remote_misses, bytes;
+};
+
+/** Fills a factor with the values it starts with in every run, which only depend on its row and table. */
+void initial_factor(const MFParams& p, lazygaspi_id_t row, lazygaspi_id_t table, double* factor){
+    std::mt19937_64 gen(p.seed ^ (table * p.users + row + 1) * 0x9E3779B97F4A7C15UL);
+    std::uniform_real_distribution<double> dist(0, 1 / std::sqrt((double)p.rank));
+    for(unsigned k = 0; k < p.rank; k++) factor[k] = dist(gen);
+}
+
+/** Generates the ratings of the users and of the items stored by the current rank, from random factors of rank `p.rank` and
+ *  Gaussian noise. Every rank generates the same ratings. */
+void generate_ratings(LazyGaspiProcessInfo* info, const MFParams& p, UserRatings* by_user, ItemRatings* by_item){
+    std::vector<Triplet<double>> user_triplets, item_triplets;
+    std::vector<double> true_items(p.items * p.rank);
+    std::mt19937_64 item_gen(p.seed + 1);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for(auto& v : true_items) v = unit(item_gen);
+
+    std::normal_distribution<double> noise(0, p.noise);
+    std::vector<double> true_user(p.rank);
+    for(lazygaspi_id_t u = 0; u < p.users; u++){
+        std::mt19937_64 gen(p.seed + 2 + u);
+        for(auto& v : true_user) v = unit(gen) / p.rank;
+        const bool own_user = get_row_location(info, u, USER_TABLE).first == info->id;
+        for(lazygaspi_id_t j = 0; j < p.items; j++){
+            if(unit(gen) >= p.density) continue;
+            double rating = noise(gen);
+            for(unsigned k = 0; k < p.rank; k++) rating += true_user[k] * true_items[j * p.rank + k];
+            if(own_user) user_triplets.emplace_back(u, j, rating);
+            if(get_row_location(info, j, ITEM_TABLE).first == info->id) item_triplets.emplace_back(u, j, rating);
+        }
+    }
+    by_user->resize(p.users, p.items);
+    by_user->setFromTriplets(user_triplets.begin(), user_triplets.end());
+    by_item->resize(p.users, p.items);
+    by_item->setFromTriplets(item_triplets.begin(), item_triplets.end());
+}
+
+/** Reads a factor, counting the read as a remote miss if the cache did not hold a fresh copy of a row of another rank. */
+void read_factor(LazyGaspiProcessInfo* info, gaspi_pointer_t cache, lazygaspi_id_t row, lazygaspi_id_t table,
+                 lazygaspi_slack_t slack, double* factor, MFCounters* c){
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+    const auto tag = (RowTag*)((char*)cache + cache_tag_offset(info, get_offset_in_cache(info, row, table)));
+    if(get_row_location(info, row, table).first != info->id &&
+       (tag->row_id != row || tag->table_id != table || tag->age < min)){
+        c->remote_misses++;
+        c->bytes += info->row_size + sizeof(RowTag);
+    }
+    SUCCESS_OR_DIE(lazygaspi_read(row, table, slack, factor));
+    c->reads++;
+}
+
+/** Writes a factor, counting the bytes of its row and tag if the row is stored by another rank. */
+void write_factor(LazyGaspiProcessInfo* info, lazygaspi_id_t row, lazygaspi_id_t table, double* factor, MFCounters* c){
+    SUCCESS_OR_DIE(lazygaspi_write(row, table, factor));
+    if(get_row_location(info, row, table).first != info->id) c->bytes += info->row_size + sizeof(RowTag);
+    c->writes++;
+}
+
+/** One SGD step on `x` for a rating, given the factor `y` it is multiplied with. Returns the error before the step. */
+double sgd_step(const MFParams& p, Factor& x, const Factor& y, double rating){
+    const double error = rating - x.dot(y);
+    x += p.learning_rate * (error * y - p.regularization * x);
+    return error;
+}
+
+/** Updates the factors of the users stored by the current rank, reading item factors with the given slack. Returns the sum of
+ *  the squared errors of all ratings of those users, before their updates. */
+double update_users(LazyGaspiProcessInfo* info, gaspi_pointer_t cache, const MFParams& p, const UserRatings& ratings,
+                    lazygaspi_slack_t slack, double* user_buf, double* item_buf, MFCounters* c){
+    double squared = 0;
+    Factor user(user_buf, p.rank), item(item_buf, p.rank);
+    for(lazygaspi_id_t u = 0; u < p.users; u++){
+        if(ratings.outerIndexPtr()[u] == ratings.outerIndexPtr()[u + 1]) continue;
+        read_factor(info, cache, u, USER_TABLE, slack, user_buf, c);
+        for(UserRatings::InnerIterator it(ratings, u); it; ++it){
+            read_factor(info, cache, it.col(), ITEM_TABLE, slack, item_buf, c);
+            const double error = sgd_step(p, user, item, it.value());
+            squared += error * error;
+        }
+        write_factor(info, u, USER_TABLE, user_buf, c);
+    }
+    return squared;
+}
+
+/** Updates the factors of the items stored by the current rank, reading user factors with the given slack. */
+void update_items(LazyGaspiProcessInfo* info, gaspi_pointer_t cache, const MFParams& p, const ItemRatings& ratings,
+                  lazygaspi_slack_t slack, double* user_buf, double* item_buf, MFCounters* c){
+    Factor user(user_buf, p.rank), item(item_buf, p.rank);
+    for(lazygaspi_id_t j = 0; j < p.items; j++){
+        if(ratings.outerIndexPtr()[j] == ratings.outerIndexPtr()[j + 1]) continue;
+        read_factor(info, cache, j, ITEM_TABLE, slack, item_buf, c);
+        for(ItemRatings::InnerIterator it(ratings, j); it; ++it){
+            read_factor(info, cache, it.row(), USER_TABLE, slack, user_buf, c);
+            sgd_step(p, item, user, it.value());
+        }
+        write_factor(info, j, ITEM_TABLE, item_buf, c);
+    }
+}
+
+/** Writes the initial factors of the current rank's rows, at an age after which no row of a previous run is fresh. */
+void reset_factors(LazyGaspiProcessInfo* info, const MFParams& p, lazygaspi_slack_t slack, double* buf){
+    for(lazygaspi_slack_t i = 0; i <= slack; i++) SUCCESS_OR_DIE(lazygaspi_clock());
+    for(lazygaspi_id_t table = USER_TABLE; table <= ITEM_TABLE; table++)
+    for(lazygaspi_id_t row = 0; row < (table == USER_TABLE ? p.users : p.items); row++){
+        if(get_row_location(info, row, table).first != info->id) continue;
+        initial_factor(p, row, table, buf);
+        SUCCESS_OR_DIE(lazygaspi_write(row, table, buf));
+    }
+}
+
+/** Prints the results of one run as a JSON object on rank 0. Must be called by all ranks. */
+void report(LazyGaspiProcessInfo* info, const MFParams& p, lazygaspi_slack_t slack, const std::vector<double>& rmse,
+            const std::vector<double>& times, const MFCounters& c){
+    double sums[4] = { c.reads, c.writes, c.remote_misses, c.bytes }, sums_out[4];
+    SUCCESS_OR_DIE(gaspi_allreduce(sums, sums_out, 4, GASPI_OP_SUM, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+    if(info->id != 0) return;
+
+    //Times are already the maxima over all ranks, accumulated over the iterations.
+    const double total = times.empty() ? 0 : times.back();
+    double time_to_target = -1;
+    for(size_t i = 0; i < rmse.size(); i++) if(rmse[i] <= p.target) { time_to_target = times[i]; break; }
+
+    std::stringstream rmse_list;
+    for(size_t i = 0; i < rmse.size(); i++) rmse_list << (i ? ", " : "") << rmse[i];
+    std::cout << "{\"app\": \"mf\", \"ranks\": " << info->n << ", \"users\": " << p.users << ", \"items\": " << p.items
+              << ", \"rank\": " << p.rank << ", \"density\": " << p.density << ", \"block_size\": " << info->shardOpts.block_size
+              << ", \"cache_size\": " << info->cacheOpts.size << ", \"slack\": " << slack << ", \"iterations\": " << p.iterations
+              << ", \"learning_rate\": " << p.learning_rate << ", \"target_rmse\": " << p.target
+              << ", \"time_to_target_s\": ";
+    if(time_to_target < 0) std::cout << "null"; else std::cout << time_to_target;
+    std::cout << ", \"time_s\": " << total << ", \"rows_per_s\": " << (total > 0 ? (sums_out[0] + sums_out[1]) / total : 0.0)
+              << ", \"reads\": " << (unsigned long)sums_out[0] << ", \"writes\": " << (unsigned long)sums_out[1]
+              << ", \"remote_misses\": " << (unsigned long)sums_out[2] << ", \"bytes_moved\": " << (unsigned long)sums_out[3]
+              << ", \"rmse\": [" << rmse_list.str() << "]}" << std::endl;
+}
+
+bool parse_slacks(const char* arg, std::vector<lazygaspi_slack_t>* slacks){
+    slacks->clear();
+    std::stringstream s(arg);
+    std::string item;
+    while(std::getline(s, item, ',')){
+        if(item.empty()) return false;
+        slacks->push_back(atol(item.c_str()));
+    }
+    return !slacks->empty();
+}
+
+int main(int argc, char** argv){
+    int      ch;
+    MFParams p = { USERS, ITEMS, 1, RANK, ITERATIONS, DENSITY, LEARNING_RATE, REGULARIZATION, NOISE, TARGET_RMSE, { 0, 1, 2, 4 },
+                   SEED };
+
+    while((ch = getopt(argc, argv, "hu:v:f:d:i:l:g:e:t:s:b:S:")) != -1) {
+        switch(ch){
+            case 'u': p.users = atol(optarg); break;
+            case 'v': p.items = atol(optarg); break;
+            case 'f': p.rank = atol(optarg); break;
+            case 'd': p.density = atof(optarg); break;
+            case 'i': p.iterations = atol(optarg); break;
+            case 'l': p.learning_rate = atof(optarg); break;
+            case 'g': p.regularization = atof(optarg); break;
+            case 'e': p.noise = atof(optarg); break;
+            case 't': p.target = atof(optarg); break;
+            case 's': if(!parse_slacks(optarg, &p.slacks)) { print_usage(); exit(EXIT_FAILURE); } break;
+            case 'b': p.block_size = atol(optarg); break;
+            case 'S': p.seed = atol(optarg); break;
+            case '?':
+            case ':':
+            default : print_usage(); exit(EXIT_FAILURE);
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+        }
+    }
+
+    if(p.users == 0 || p.items == 0 || p.rank == 0 || p.iterations == 0 || p.density <= 0){
+        print_usage(); exit(EXIT_FAILURE);
+    }
+
+    //Both tables have as many rows as the larger one. By default, rows are assigned to the ranks one at a time.
+    const lazygaspi_id_t table_size = std::max(p.users, p.items);
+    SUCCESS_OR_DIE_COUT(lazygaspi_init(2, table_size, p.rank * sizeof(double), ShardingOptions(p.block_size),
+                                       CachingOptions(nullptr, 0)));
+
+    LazyGaspiProcessInfo* info;
+    SUCCESS_OR_DIE_COUT(lazygaspi_get_info(&info));
+
+    gaspi_pointer_t cache;
+    SUCCESS_OR_DIE(gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache));
+
+    UserRatings by_user;
+    ItemRatings by_item;
+    generate_ratings(info, p, &by_user, &by_item);
+    double local_ratings = by_user.nonZeros(), ratings;
+    SUCCESS_OR_DIE(gaspi_allreduce(&local_ratings, &ratings, 1, GASPI_OP_SUM, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+
+    std::vector<double> user_buf(p.rank), item_buf(p.rank);
+
+    for(auto slack : p.slacks){
+        reset_factors(info, p, slack, user_buf.data());
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+
+        MFCounters counters = {};
+        std::vector<double> rmse, times;
+        double elapsed = 0;
+        for(unsigned it = 0; it < p.iterations; it++){
+            const auto beg = get_time();
+            SUCCESS_OR_DIE(lazygaspi_clock());
+            double squared = update_users(info, cache, p, by_user, slack, user_buf.data(), item_buf.data(), &counters);
+            update_items(info, cache, p, by_item, slack, user_buf.data(), item_buf.data(), &counters);
+            double local[2] = { squared, get_time() - beg }, global[2];
+            SUCCESS_OR_DIE(gaspi_allreduce(local, global, 1, GASPI_OP_SUM, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+            SUCCESS_OR_DIE(gaspi_allreduce(local + 1, global + 1, 1, GASPI_OP_MAX, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL,
+                                           GASPI_BLOCK));
+            elapsed += global[1];
+            rmse.push_back(std::sqrt(global[0] / ratings));
+            times.push_back(elapsed);
+        }
+        report(info, p, slack, rmse, times, counters);
+    }
+
+    SUCCESS_OR_DIE(lazygaspi_term());
+
+    return EXIT_SUCCESS;
+}
+
+void print_usage(){
+    std::cout << "Usage: gaspi_run <...args...> [OPTIONS]\n\n"
+              << "Parameters:\n"
+              << "  [-u <users>]:           The amount of users (rows of the ratings matrix). Default is " << USERS << ".\n"
+              << "  [-v <items>]:           The amount of items (columns of the ratings matrix). Default is " << ITEMS << ".\n"
+              << "  [-f <rank>]:            The amount of values in a factor. Default is " << RANK << ".\n"
+              << "  [-d <density>]:         The fraction of all ratings that exist. Default is " << DENSITY << ".\n"
+              << "  [-i <iterations>]:      The amount of iterations of each run. Default is " << ITERATIONS << ".\n"
+              << "  [-l <rate>]:            The learning rate. Default is " << LEARNING_RATE << ".\n"
+              << "  [-g <regularization>]:  The regularization factor. Default is " << REGULARIZATION << ".\n"
+              << "  [-e <noise>]:           The standard deviation of the noise added to ratings. Default is " << NOISE << ".\n"
+              << "  [-t <rmse>]:            The RMSE whose time is reported. Default is " << TARGET_RMSE << ".\n"
+              << "  [-s <slack>[,...]]:     The slack of each run. Default is 0,1,2,4.\n"
+              << "  [-b <block_size>]:      The sharding block size, in rows. Default is 1.\n"
+              << "  [-S <seed>]:            The random seed. Default is " << SEED << ".\n\n"
+              << "Results are printed by rank 0 as one JSON object per run.\n"
+              << std::endl;
+}
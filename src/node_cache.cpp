@@ -0,0 +1,222 @@
+#include "lazygaspi_hs.h"
+#include "utils.h"
+#include "gaspi_utils.h"
+
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//The node cache starts with a header that counts the ranks that mapped it, padded so that entries stay aligned.
+#define NODE_HEADER_SIZE ENTRY_ALIGNMENT
+
+typedef uint64_t Sequence;
+
+struct NodeCache{
+    char* entries = nullptr;
+    gaspi_size_t size = 0;
+};
+static PerInstance<NodeCache> node_cache;
+
+/** Distance, in bytes, from the tag of a row to its data. It is the same in the rows segment and in the node cache. */
+static inline gaspi_size_t tag_to_data(const LazyGaspiProcessInfo* info){
+    (void)info;
+    #ifdef SOA_LAYOUT
+    return sizeof(RowTag);
+    #else
+    return ROW_DATA_OFFSET - ROW_METADATA_OFFSET;
+    #endif
+}
+
+static inline gaspi_offset_t node_data_in_entry(const LazyGaspiProcessInfo* info){
+    return align_up(sizeof(Sequence) + tag_to_data(info), DATA_ALIGNMENT);
+}
+
+static inline gaspi_size_t node_entry_size(const LazyGaspiProcessInfo* info){
+    return align_up(node_data_in_entry(info) + info->row_size, ENTRY_ALIGNMENT);
+}
+
+static inline gaspi_offset_t node_seq_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t nslot){
+    return NODE_HEADER_SIZE + node_entry_size(info) * nslot;
+}
+
+static inline gaspi_offset_t node_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t nslot){
+    return node_seq_offset(info, nslot) + node_data_in_entry(info) - tag_to_data(info);
+}
+
+static inline gaspi_offset_t node_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t nslot){
+    return node_seq_offset(info, nslot) + node_data_in_entry(info);
+}
+
+gaspi_return_t node_cache_init(LazyGaspiProcessInfo* info){
+    if(info->cacheOpts.node_size == 0) return GASPI_SUCCESS;
+
+    //Every rank on a host must open the same object, so it is named after rank 0 of this run and the current instance.
+    char hostname[256] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+    unsigned long key[2] = {0, 0}, run[2];
+    if(info->id == 0){
+        key[0] = (unsigned long)getpid();
+        key[1] = (unsigned long)std::hash<std::string>()(hostname);
+    }
+    auto r = gaspi_allreduce(key, run, 2, GASPI_OP_MAX, GASPI_TYPE_ULONG, GASPI_GROUP_ALL, GASPI_BLOCK); ERROR_CHECK;
+    char name[64];
+    snprintf(name, sizeof(name), "/lazygaspi_hs.%lx.%lx.%u", run[0], run[1], (unsigned int)lazygaspi_current_instance);
+
+    node_cache->size = node_seq_offset(info, info->cacheOpts.node_size);
+    PRINT_DEBUG_INTERNAL("Mapping node cache " << name << " with " << info->cacheOpts.node_size << " entries ("
+                         << node_cache->size << " bytes)...");
+
+    //Extending the object to the same size again does not change it, so no rank has to create it first.
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if(fd < 0){
+        PRINT_ON_ERROR("Failed to open shared memory object " << name);
+        return GASPI_ERROR;
+    }
+    if(ftruncate(fd, node_cache->size) != 0){
+        close(fd);
+        PRINT_ON_ERROR("Failed to resize shared memory object " << name);
+        return GASPI_ERR_MEMALLOC;
+    }
+    auto ptr = mmap(nullptr, node_cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(ptr == MAP_FAILED){
+        PRINT_ON_ERROR("Failed to map shared memory object " << name);
+        return GASPI_ERR_MEMALLOC;
+    }
+    node_cache->entries = (char*)ptr;
+    __atomic_fetch_add((unsigned long*)node_cache->entries, 1, __ATOMIC_ACQ_REL);
+
+    //Once all ranks mapped the object, its name is no longer needed. It is freed when the last rank unmaps it.
+    r = GASPI_BARRIER; ERROR_CHECK;
+    shm_unlink(name);
+    const auto ranks = __atomic_load_n((unsigned long*)node_cache->entries, __ATOMIC_ACQUIRE);
+    r = GASPI_BARRIER; ERROR_CHECK;
+
+    if(ranks < 2){
+        PRINT_DEBUG_INTERNAL(" | No other rank runs on this host. Node cache was disabled.");
+        munmap(node_cache->entries, node_cache->size);
+        node_cache->entries = nullptr;
+        info->cacheOpts.node_size = 0;
+        return GASPI_SUCCESS;
+    }
+
+    PRINT_DEBUG_INTERNAL(" | Node cache is shared by " << ranks << " ranks.");
+    r = gaspi_segment_bind(LAZYGASPI_ID_NODE_CACHE, node_cache->entries, node_cache->size, 0); ERROR_CHECK;
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t node_cache_term(LazyGaspiProcessInfo* info){
+    (void)info;
+    if(node_cache->entries == nullptr) return GASPI_SUCCESS;
+    auto r = gaspi_segment_delete(LAZYGASPI_ID_NODE_CACHE); ERROR_CHECK;
+    munmap(node_cache->entries, node_cache->size);
+    node_cache->entries = nullptr;
+    return GASPI_SUCCESS;
+}
+
+/** Copies an entry of the node cache into a slot of the local cache if it holds the given row, unless the slot already holds the
+ *  same or a newer version. Returns the sequence of the entry that was copied (or found not to hold the row).
+ *
+ *  Parameters:
+ *  copied - Output parameter. Set to true if the entry holds the row, even if it was not newer than the slot.
+ */
+static Sequence copy_from_node(const LazyGaspiProcessInfo* info, gaspi_offset_t nslot, char* cache, gaspi_offset_t slot,
+                               lazygaspi_id_t row_id, lazygaspi_id_t table_id, bool* copied){
+    auto seq = (Sequence*)(node_cache->entries + node_seq_offset(info, nslot));
+    auto cached = (RowTag*)(cache + cache_tag_offset(info, slot));
+    while(true){
+        const auto s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        //Another rank is reading a row into the entry.
+        if(s & 1) continue;
+
+        RowTag tag;
+        memcpy(&tag, node_cache->entries + node_tag_offset(info, nslot), sizeof(RowTag));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(seq, __ATOMIC_RELAXED) != s) continue;
+
+        *copied = tag.row_id == row_id && tag.table_id == table_id;
+        if(!*copied) return s;
+        if(cached->row_id == row_id && cached->table_id == table_id && cached->age >= tag.age) return s;
+
+        memcpy(cache + cache_data_offset(info, slot), node_cache->entries + node_data_offset(info, nslot), info->row_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(seq, __ATOMIC_RELAXED) != s) continue;
+        *cached = tag;
+        return s;
+    }
+}
+
+/** Copies a row from the rows segment of `rank` into an entry of the node cache, without locking it. */
+static gaspi_return_t transfer_into_node(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                         gaspi_offset_t nslot){
+    const ReadNotifications notif;
+    gaspi_return_t r;
+    #ifdef SOA_LAYOUT
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_NODE_CACHE, rows_data_offset(info, index), node_data_offset(info, nslot),
+                   info->row_size, rank, notif.first + 1);
+    ERROR_CHECK;
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_NODE_CACHE, rows_tag_offset(info, index), node_tag_offset(info, nslot),
+                   sizeof(RowTag), rank, notif.first);
+    #else
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_NODE_CACHE, rows_tag_offset(info, index), node_tag_offset(info, nslot),
+                   ROW_SIZE_IN_CACHE, rank, notif.first);
+    #endif
+    ERROR_CHECK;
+    return wait_for_notifications(LAZYGASPI_ID_NODE_CACHE, notif.first, NOTIF_ROWS_READ_AMOUNT);
+}
+
+/** Reads a row from the rows segment of `rank` into an entry of the node cache. The caller must hold the entry (odd sequence). */
+static gaspi_return_t read_into_node(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index, gaspi_offset_t nslot){
+    #ifdef LOCKED_OPERATIONS
+    auto r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank); ERROR_CHECK;
+    r = transfer_into_node(info, rank, index, nslot);
+    //The row is unlocked even if the read failed, so that its owner is not blocked forever.
+    const auto unlocked = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank);
+    if(r == GASPI_SUCCESS) r = unlocked;
+    ERROR_CHECK;
+    return GASPI_SUCCESS;
+    #else
+    return transfer_into_node(info, rank, index, nslot);
+    #endif
+}
+
+gaspi_return_t fetch_row_through_node(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index, gaspi_offset_t slot,
+                                      lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_age_t min){
+    gaspi_pointer_t cache;
+    auto r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+
+    const auto nslot = info->cacheOpts.hash(row_id, table_id, info) % info->cacheOpts.node_size;
+    auto seq = (Sequence*)(node_cache->entries + node_seq_offset(info, nslot));
+
+    while(true){
+        bool copied;
+        auto s = copy_from_node(info, nslot, (char*)cache, slot, row_id, table_id, &copied);
+        if(copied && ((RowTag*)((char*)cache + cache_tag_offset(info, slot)))->age >= min){
+            PRINT_DEBUG_INTERNAL(" | : Found row in node cache.");
+            return GASPI_SUCCESS;
+        }
+
+        //If another rank started reading a row into the entry, check the entry again once it is done.
+        if(!__atomic_compare_exchange_n(seq, &s, s + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+
+        PRINT_DEBUG_INTERNAL(" | : Reading row into node cache...");
+        r = read_into_node(info, rank, index, nslot);
+        if(r != GASPI_SUCCESS){
+            //The entry is released anyway, so that other ranks do not wait for it forever. Its contents might be partial, so it is
+            //marked as holding no row.
+            const RowTag none((lazygaspi_age_t)0, (lazygaspi_id_t)-1, (lazygaspi_id_t)-1);
+            memcpy(node_cache->entries + node_tag_offset(info, nslot), &none, sizeof(RowTag));
+            __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+            ERROR_CHECK;
+        }
+        __atomic_store_n(seq, s + 2, __ATOMIC_RELEASE);
+
+        //The row might still be old, in which case the caller decides whether to read it again.
+        copy_from_node(info, nslot, (char*)cache, slot, row_id, table_id, &copied);
+        return GASPI_SUCCESS;
+    }
+}
@@ -2,58 +2,136 @@
 #include "utils.h"
 #include "gaspi_utils.h"
 
-gaspi_return_t lazygaspi_fulfill_prefetches(){
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <numeric>
+#include <algorithm>
+#include <mutex>
+
+/** The last read of a row of another rank, recorded for LazyGaspiProcessInfo::auto_prefetch. */
+struct ReadPattern{
+    //The age in which the row was last read.
+    lazygaspi_age_t age;
+    //The smallest slack the row was read with in that age.
+    lazygaspi_slack_t slack;
+};
+//Indexed by table_id * table_size + row_id.
+static PerInstance<std::unordered_map<gaspi_offset_t, ReadPattern>> read_patterns;
+
+/** A request that the current row satisfies, found by lazygaspi_fulfill_prefetches. */
+struct PendingPrefetch{
+    lazygaspi_age_t request;
+    gaspi_rank_t rank;
+    //The offset, in rows, of the row's entry in the rows segment.
+    gaspi_offset_t index;
+};
+//True if the last call to lazygaspi_fulfill_prefetches left satisfied requests pending, whose notification was already consumed.
+static PerInstance<bool> requests_left;
+
+/** Posts the transfer of entry `i` of the rows segment to the cache of `rank`, whose request for it was cleared. */
+static gaspi_return_t push_prefetch(LazyGaspiProcessInfo* info, gaspi_pointer_t rows_table, gaspi_rank_t rank, gaspi_offset_t i,
+                                    lazygaspi_age_t request){
+    (void)request;
+    auto data = (RowTag*)((char*)rows_table + rows_tag_offset(info, i));
+    PRINT_DEBUG_INTERNAL("Writing row to requesting rank. Minimum age was " << request_age(request) << ", priority was "
+                << (int)request_priority(request) << ", current age was " << data->age << ". ID's were " 
+                << data->row_id << '/' << data->table_id << '.');
+    LOG_EVENT(LOG_PREFETCH_PUSH, data->row_id, data->table_id, rank, data->age);
+
+    const auto slot = get_offset_in_cache(info, data->row_id, data->table_id);
+    gaspi_return_t r;
+    #ifdef LOCKED_OPERATIONS
+        r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id); ERROR_CHECK;
+        r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), rank); ERROR_CHECK;
+    #endif
+
+    r = push_row_to_cache(info, rank, i, slot);
+    ERROR_CHECK;
+
+    #ifdef LOCKED_OPERATIONS
+        r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), rank); ERROR_CHECK;
+        r = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id); ERROR_CHECK;
+    #endif
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t push_requested_row(LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    gaspi_pointer_t rows_table;
+    auto r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows_table); ERROR_CHECK;
+
+    bool requested = false;
+    for(gaspi_rank_t rank = 0; rank < info->n && !requested; rank++){
+        auto flag = (lazygaspi_age_t*)((char*)rows_table + rows_request_offset(info, index, rank));
+        requested = __atomic_load_n(flag, __ATOMIC_RELAXED) != 0;
+    }
+    if(!requested) return GASPI_SUCCESS;
+
+    //The write that made the row fresh might still be in flight on queue 0.
+    r = wait_for_queue(0); ERROR_CHECK;
+    for(gaspi_rank_t rank = 0; rank < info->n; rank++){
+        const auto request = get_prefetch(info, rows_table, index, rank);
+        if(request == 0 || !clear_prefetch(info, rows_table, index, rank, request)) continue;
+        r = push_prefetch(info, rows_table, rank, index, request); ERROR_CHECK;
+    }
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_fulfill_prefetches(gaspi_size_t budget){
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK;
 
     PRINT_DEBUG_INTERNAL("Fulfillling prefetch requests...");
+    TRACE_SCOPE(TRACE_FULFILL_SCAN);
 
     Notification notif;
     r = get_notification(LAZYGASPI_ID_ROWS, NOTIF_ID_ROW_WRITTEN, 1, &notif, GASPI_TEST);
-    if(r == GASPI_TIMEOUT){
+    ERROR_CHECK;
+    if(notif.val == 0 && !*requests_left){
         PRINT_DEBUG_INTERNAL("No notice of new rows was found.");
         return GASPI_SUCCESS;    //No "new row" notice, no prefetching necessary.
     }
-    ERROR_CHECK;
+    *requests_left = false;
 
     gaspi_pointer_t rows_table;
     r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows_table); ERROR_CHECK;
 
-    const auto entry_size = ROW_SIZE_IN_TABLE_WITH_LOCK;
     const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
 
+    //get_prefetch only returns requests the current row satisfies; unsatisfied ones stay pending for a later write.
+    std::vector<PendingPrefetch> pending;
     for(gaspi_rank_t rank = 0; rank < info->n; rank++)
-    for(gaspi_offset_t i = 0; i < row_amount; i++){
-        if(auto min = get_prefetch(info, rows_table, entry_size * i, rank)){
-            auto data = (LazyGaspiRowData*)((char*)rows_table + entry_size * i);
-            //If a new row is written while this is happening, the new row will be expected to have an age bigger than 
-            //the previous age (TODO: not actually made explicit), which will also satisfy this condition.
-            if(data->age >= min){ 
-                if(info->table_size == 0) return GASPI_ERR_NOINIT;
-                PRINT_DEBUG_INTERNAL("Writing row to requesting rank. Minimum age was " << min << ", current age was " << data->age 
-                            << ". ID's were " << data->row_id << '/' << data->table_id << '.');
-
-                const auto cache_offset = get_offset_in_cache(info, data->row_id, data->table_id) * ROW_SIZE_IN_CACHE_WITH_LOCK;
-                #ifdef LOCKED_OPERATIONS
-                    r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, entry_size * i + ROW_LOCK_OFFSET, info->id); ERROR_CHECK;
-                    r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_offset + ROW_LOCK_OFFSET, rank); ERROR_CHECK;
-                #endif
-
-                r = write(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, entry_size * i + ROW_METADATA_OFFSET, 
-                          cache_offset + ROW_METADATA_OFFSET, ROW_SIZE_IN_CACHE, rank);
-                ERROR_CHECK;
-
-                #ifdef LOCKED_OPERATIONS
-                    r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_offset + ROW_LOCK_OFFSET, rank); ERROR_CHECK;
-                    r = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, entry_size * i + ROW_LOCK_OFFSET, info->id); ERROR_CHECK;
-                #endif
-            }
-        } 
+    for(gaspi_offset_t i = 0; i < row_amount; i++)
+        if(auto request = get_prefetch(info, rows_table, i, rank)) pending.push_back({request, rank, i});
+
+    std::stable_sort(pending.begin(), pending.end(), [](const PendingPrefetch& a, const PendingPrefetch& b){
+        return request_priority(a.request) > request_priority(b.request);
+    });
+
+    const gaspi_size_t row_bytes = sizeof(RowTag) + info->row_size;
+    gaspi_size_t pushed = 0;
+    for(auto& prefetch : pending){
+        if(budget != 0 && pushed != 0 && pushed + row_bytes > budget){
+            PRINT_DEBUG_INTERNAL("Budget of " << budget << " bytes was reached. Leaving remaining requests for the next call.");
+            *requests_left = true;
+            break;
+        }
+        //The rank wrote a new request since the scan, which the next call checks again.
+        if(!clear_prefetch(info, rows_table, prefetch.index, prefetch.rank, prefetch.request)){
+            *requests_left = true;
+            continue;
+        }
+
+        if(info->table_size == 0) return GASPI_ERR_NOINIT;
+        r = push_prefetch(info, rows_table, prefetch.rank, prefetch.index, prefetch.request); ERROR_CHECK;
+        pushed += row_bytes;
     }
     return GASPI_SUCCESS;
 }
 
-gaspi_return_t lazygaspi_prefetch(lazygaspi_id_t* row_vec, lazygaspi_id_t* table_vec, size_t size, lazygaspi_slack_t slack){
+gaspi_return_t lazygaspi_prefetch(lazygaspi_id_t* row_vec, lazygaspi_id_t* table_vec, size_t size, lazygaspi_slack_t slack,
+                                  const lazygaspi_priority_t* preferences){
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK;
     
@@ -64,34 +142,58 @@ gaspi_return_t lazygaspi_prefetch(lazygaspi_id_t* row_vec, lazygaspi_id_t* table
     }
     #endif
 
+    TRACE_SCOPE(TRACE_PREFETCH);
     gaspi_rank_t rank;
     gaspi_offset_t offset;
-    info->communicator = get_min_age(info->age, slack, info->offset_slack);
-    PRINT_DEBUG_INTERNAL(" Writing " << size << " prefetch requests with minimum age " << info->communicator << "...");
-    while(size--){
-        PRINT_DEBUG_INTERNAL(" | : Requesting row " << *row_vec << " from table " << *table_vec << " with minimum age " << 
-                            info->communicator << "...");
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+    PRINT_DEBUG_INTERNAL(" Writing " << size << " prefetch requests with minimum age " << min << "...");
+
+    //Requests are written by descending priority, so that the communicator only changes once per priority.
+    std::vector<size_t> order(size);
+    std::iota(order.begin(), order.end(), 0);
+    if(preferences) std::stable_sort(order.begin(), order.end(), [preferences](size_t a, size_t b){
+        return preferences[a] > preferences[b];
+    });
+
+    //A row requested twice is only pushed once, and the later request would replace the priority of the first one.
+    std::unordered_set<gaspi_offset_t> requested;
+    bool first = true;
+    for(auto k : order){
+        const lazygaspi_priority_t priority = preferences ? preferences[k] : 0;
+        PRINT_DEBUG_INTERNAL(" | : Requesting row " << row_vec[k] << " from table " << table_vec[k] << " with priority " << 
+                            (int)priority << "...");
         #ifdef SAFETY_CHECKS
-        if(*row_vec >= info->table_size || *table_vec >= info->table_amount){
+        if(row_vec[k] >= info->table_size || table_vec[k] >= info->table_amount){
             PRINT_ON_ERROR("Row/table ID was out of bounds.");
             return GASPI_ERR_INV_NUM;
         }
         #endif
+        if(size > 1 && !requested.insert((gaspi_offset_t)table_vec[k] * info->table_size + row_vec[k]).second){
+            PRINT_DEBUG_INTERNAL(" | : > Row was already requested. Ignoring request.");
+            continue;
+        }
+        if(first || request_priority(info->communicator) != priority){
+            if(!first) set_communicator_ticket(take_ticket());
+            r = set_communicator(info, make_request(min, priority)); ERROR_CHECK;
+            first = false;
+        }
         
-        std::tie(rank, offset) = get_row_location(info, *row_vec, *table_vec);
+        std::tie(rank, offset) = get_row_location(info, row_vec[k], table_vec[k]);
         if(rank == info->id){
             PRINT_DEBUG_INTERNAL(" | : > Tried to prefetch from own rows table. Ignoring request.");
             continue;
         }
-        auto flag_offset = offset * ROW_SIZE_IN_TABLE_WITH_LOCK + ROW_REQUEST_OFFSET(info->id);
+        auto flag_offset = rows_request_offset(info, offset, info->id);
 
-        r = write(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, communicator), 
-                  flag_offset,  sizeofmember(LazyGaspiProcessInfo, communicator), rank);
+        r = writenotify(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, communicator), 
+                        flag_offset,  sizeofmember(LazyGaspiProcessInfo, communicator), rank, NOTIF_ID_ROW_WRITTEN);
         ERROR_CHECK;
+        LOG_EVENT(LOG_PREFETCH, row_vec[k], table_vec[k], rank, min);
     }
 
-    PRINT_DEBUG_INTERNAL(" | Wrote all prefetch requests. Waiting on queue 0...");
-    return gaspi_wait(0, GASPI_BLOCK);
+    PRINT_DEBUG_INTERNAL(" | Posted all prefetch requests.");
+    set_communicator_ticket(take_ticket());
+    return GASPI_SUCCESS;
 }
 
 gaspi_return_t lazygaspi_prefetch_all(lazygaspi_slack_t slack){
@@ -101,13 +203,26 @@ gaspi_return_t lazygaspi_prefetch_all(lazygaspi_slack_t slack){
         PRINT_DEBUG_INTERNAL("Error: clock must be called at least once before prefetch.");
         return GASPI_ERR_NOINIT;
     }   
-    info->communicator = get_min_age(info->age, slack, info->offset_slack);
+    r = set_communicator(info, get_min_age(info->age, slack, info->offset_slack)); ERROR_CHECK;
 
     PRINT_DEBUG_INTERNAL("Writing prefetch requests for all rows of all tables...");
+    TRACE_SCOPE(TRACE_PREFETCH);
 
     gaspi_rank_t rank;
     gaspi_offset_t offset;
 
+    gaspi_pointer_t cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+    const bool staging = get_staging_capacity(info) != 0;
+    std::unique_lock<std::mutex> staging_lock(*staging_mutex, std::defer_lock);
+    if(staging){
+        staging_lock.lock();
+        r = wait_for_staging(info); ERROR_CHECK;
+    }
+    //Per rank: its modification ages, which are only fetched once a fresh row of the rank is found in the cache.
+    std::vector<std::vector<lazygaspi_age_t>> modified(info->n);
+    std::vector<bool> fetched(info->n, false);
+
     for(lazygaspi_id_t table = 0; table < info->table_amount; table++)
     for(lazygaspi_id_t row = 0; row < info->table_size; row++){
         PRINT_DEBUG_INTERNAL(" | Prefetching row " << row << " of table " << table << "...");
@@ -117,13 +232,77 @@ gaspi_return_t lazygaspi_prefetch_all(lazygaspi_slack_t slack){
             PRINT_DEBUG_INTERNAL(" | : Tried to prefetch from own rows table. Ignoring request.");
             continue;
         }
-        auto flag_offset = offset * ROW_SIZE_IN_TABLE_WITH_LOCK + ROW_REQUEST_OFFSET(info->id);
 
-        r = write(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, communicator), 
-                 flag_offset, sizeofmember(LazyGaspiProcessInfo, communicator), rank);
+        //A fresh cached row that is no older than the last write to its block would only be pushed again.
+        auto cached = (RowTag*)((char*)cache + cache_tag_offset(info, get_offset_in_cache(info, row, table)));
+        if(staging && cached->age >= info->communicator && cached->row_id == row && cached->table_id == table){
+            if(!fetched[rank]){
+                const auto blocks = get_modified_block_amount(
+                                    get_row_amount(info->table_size, info->table_amount, info->n, rank, info->shardOpts));
+                modified[rank].resize(blocks);
+                r = fetch_modified_ages(info, rank, 0, blocks, modified[rank].data()); ERROR_CHECK;
+                fetched[rank] = true;
+            }
+            if(cached->age >= modified[rank][offset / MODIFIED_BLOCK_ROWS]){
+                PRINT_DEBUG_INTERNAL(" | : Cached row is the latest. Ignoring request.");
+                continue;
+            }
+        }
+        auto flag_offset = rows_request_offset(info, offset, info->id);
+
+        r = writenotify(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, communicator), 
+                        flag_offset, sizeofmember(LazyGaspiProcessInfo, communicator), rank, NOTIF_ID_ROW_WRITTEN);
         ERROR_CHECK;
+        LOG_EVENT(LOG_PREFETCH, row, table, rank, info->communicator);
+    }
+
+    PRINT_DEBUG_INTERNAL(" | Posted all prefetch requests.");
+    set_communicator_ticket(take_ticket());
+    return GASPI_SUCCESS;
+}
+
+void record_read_pattern(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack){
+    auto& pattern = (*read_patterns)[(gaspi_offset_t)table_id * info->table_size + row_id];
+    if(pattern.age != info->age){
+        pattern.age = info->age;
+        pattern.slack = slack;
     }
+    else if(slack < pattern.slack) pattern.slack = slack;
+}
+
+gaspi_return_t prefetch_read_pattern(LazyGaspiProcessInfo* info){
+    PRINT_DEBUG_INTERNAL("Prefetching the " << read_patterns->size() << " rows read in the last " 
+                         << info->auto_prefetch_history << " ages...");
+
+    gaspi_pointer_t cache;
+    auto r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+
+    //Rows are requested together with all others read with the same slack, since a request carries its minimum age.
+    std::map<lazygaspi_slack_t, std::pair<std::vector<lazygaspi_id_t>, std::vector<lazygaspi_id_t>>> requests;
+    for(auto it = read_patterns->begin(); it != read_patterns->end();){
+        if(info->age - it->second.age > info->auto_prefetch_history){
+            it = read_patterns->erase(it);
+            continue;
+        }
+        const auto row = (lazygaspi_id_t)(it->first % info->table_size);
+        const auto table = (lazygaspi_id_t)(it->first / info->table_size);
+        const auto slack = it->second.slack;
+        it++;
 
-    PRINT_DEBUG_INTERNAL(" | Wrote all prefetch requests.");
-    return gaspi_wait(0, GASPI_BLOCK);
-}
\ No newline at end of file
+        //A cached row that is already fresh enough for the next read is not requested again.
+        auto cached = (RowTag*)((char*)cache + cache_tag_offset(info, get_offset_in_cache(info, row, table)));
+        if(cached->row_id == row && cached->table_id == table && 
+           cached->age >= get_min_age(info->age, slack, info->offset_slack)) continue;
+
+        auto& request = requests[slack];
+        request.first.push_back(row);
+        request.second.push_back(table);
+    }
+
+    for(auto& request : requests){
+        r = lazygaspi_prefetch(request.second.first.data(), request.second.second.data(), request.second.first.size(), 
+                               request.first);
+        ERROR_CHECK;
+    }
+    return GASPI_SUCCESS;
+}
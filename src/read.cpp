@@ -3,6 +3,10 @@
 #include "gaspi_utils.h"
 
 #include <cstring>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #ifdef LOCKED_OPERATIONS
 gaspi_return_t lock_row_for_read(const LazyGaspiProcessInfo* info, const gaspi_segment_id_t seg, const gaspi_offset_t offset, 
@@ -12,6 +16,7 @@ gaspi_return_t lock_row_for_read(const LazyGaspiProcessInfo* info, const gaspi_s
     const auto n = info->n;
 
     PRINT_DEBUG_INTERNAL(" | : Locking row from segment " << (int)seg << " at offset " << offset << " of rank " << rank << " for READ.");
+    TRACE_SCOPE(TRACE_LOCK_SPIN);
 
     wait_for_lock:
     do {
@@ -49,12 +54,71 @@ gaspi_return_t unlock_row_from_read(const LazyGaspiProcessInfo* info, const gasp
 }
 #endif
 
+/** Waits until another rank publishes a clock of at least `min`, after which a row with that age may exist, or until 
+ *  `info->push_timeout` expires. The thread yields between checks, so that other threads of the rank can make progress. */
+static void wait_for_clocks(LazyGaspiProcessInfo* info, const lazygaspi_age_t min){
+    TRACE_SCOPE(TRACE_WAIT);
+    PRINT_DEBUG_INTERNAL(" | : No rank has reached age " << min << " yet. Waiting for their clocks...");
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(info->push_timeout);
+    while(!fresh_row_may_exist(info, min)){
+        if(info->push_timeout != GASPI_BLOCK && std::chrono::steady_clock::now() >= deadline){
+            PRINT_DEBUG_INTERNAL(" | : > Timed out. Reading row again...");
+            return;
+        }
+        std::this_thread::yield();
+    }
+    PRINT_DEBUG_INTERNAL(" | : > A rank reached age " << min << '.');
+}
+
+/** Registers a prefetch request for a row at its rank and waits until a fresh row is pushed to the cache or until 
+ *  `info->push_timeout` expires.
+ * 
+ *  Parameters:
+ *  rowData - A pointer to the tag of the row's cache entry.
+ *  index   - The offset, in rows, of the row's entry in the rows segment of `rank`.
+ *  rank    - The rank that stores the row.
+ *  min     - The minimum age of the row.
+ *  pushed  - Output parameter. Set to false if the wait timed out.
+ */
+static gaspi_return_t wait_for_row_push(LazyGaspiProcessInfo* info, const RowTag* rowData, const gaspi_offset_t index, 
+                                        const gaspi_rank_t rank, const lazygaspi_age_t min, bool* pushed){
+    TRACE_SCOPE(TRACE_WAIT);
+    PRINT_DEBUG_INTERNAL(" | : Row was too old. Waiting for rank " << rank << " to push a row with age " << min << "...");
+
+    //The reader is blocked until the row arrives, so its request is pushed before any prefetch.
+    auto r = set_communicator(info, make_request(min, LAZYGASPI_PRIORITY_MAX)); ERROR_CHECK;
+    r = writenotify(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, communicator), 
+                    rows_request_offset(info, index, info->id), sizeofmember(LazyGaspiProcessInfo, communicator), rank, 
+                    NOTIF_ID_ROW_WRITTEN);
+    ERROR_CHECK;
+    set_communicator_ticket(take_ticket());
+
+    //Any push to the cache is notified with the same ID, so the tag must be checked after each one. Pushes of other rows do not 
+    //extend the wait.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(info->push_timeout);
+    Notification notif;
+    do {
+        gaspi_timeout_t timeout = info->push_timeout;
+        if(timeout != GASPI_BLOCK){
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = left.count() > 0 ? left.count() : GASPI_TEST;
+        }
+        r = get_notification(LAZYGASPI_ID_CACHE, NOTIF_ID_ROW_PUSHED, 1, &notif, timeout); ERROR_CHECK;
+        if(timeout == GASPI_TEST) break;
+    } while(notif.val != 0 && rowData->age < min);
+
+    *pushed = rowData->age >= min;
+    PRINT_DEBUG_INTERNAL(" | : > " << (*pushed ? "Row was pushed." : "Timed out. Reading row again..."));
+    return GASPI_SUCCESS;
+}
+
 gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack, void* row,
                               LazyGaspiRowData* data){
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
     
     PRINT_DEBUG_INTERNAL("Reading row " << row_id << " of table " << table_id << "...");
+    TRACE_SCOPE(TRACE_READ, row_id, table_id);
 
     #ifdef SAFETY_CHECKS
     if(row == nullptr){
@@ -76,18 +140,18 @@ gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, la
     gaspi_pointer_t cache;
     r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
 
-    auto offset_cache = get_offset_in_cache(info, row_id, table_id) * ROW_SIZE_IN_CACHE_WITH_LOCK;
-    auto rowData = (LazyGaspiRowData*)((char*)cache + offset_cache + ROW_METADATA_OFFSET);
+    auto slot = get_offset_in_cache(info, row_id, table_id);
+    auto rowData = (RowTag*)((char*)cache + cache_tag_offset(info, slot));
 
     gaspi_rank_t rank;
-    gaspi_offset_t offset;
-    std::tie(rank, offset) = get_row_location(info, row_id, table_id);
-    offset *= ROW_SIZE_IN_TABLE_WITH_LOCK;
+    gaspi_offset_t index;
+    std::tie(rank, index) = get_row_location(info, row_id, table_id);
+    if(info->auto_prefetch && rank != info->id) record_read_pattern(info, row_id, table_id, slack);
 
     PRINT_DEBUG_INTERNAL(" | Reading row from rank " << rank << " with slack " << slack 
                         << " and current age " << info->age << ". Minimum age was " << min << ". Rows offset is " << 
-                        offset + ROW_METADATA_OFFSET << " bytes and cache offset is " << offset_cache + ROW_METADATA_OFFSET << 
-                        " bytes. Row size is " << info->row_size << " bytes plus " << sizeof(LazyGaspiRowData) << " metadata bytes.");
+                        rows_tag_offset(info, index) << " bytes and cache offset is " << cache_tag_offset(info, slot) << 
+                        " bytes. Row size is " << info->row_size << " bytes plus " << sizeof(RowTag) << " metadata bytes.");
 
     #if defined(DEBUG) || defined(DEBUG_INTERNAL)
         unsigned attempt_counter = 0;
@@ -96,44 +160,483 @@ gaspi_return_t lazygaspi_read(lazygaspi_id_t row_id, lazygaspi_id_t table_id, la
         else { PRINT_DEBUG_INTERNAL(" | Could not find row in cache... Reading from server."); }
     #endif
 
+    //A row kept in write-back mode is newer than the row its rank stores, but might have been replaced in the cache.
+    if(rowData->age < min || rowData->row_id != row_id || rowData->table_id != table_id){
+        r = restore_kept_row(info, row_id, table_id, slot); ERROR_CHECK;
+    }
+
+    #ifdef READ_STATS
+        const auto wait_begin = std::chrono::steady_clock::now();
+        const bool waited = rowData->age < min || rowData->row_id != row_id || rowData->table_id != table_id;
+    #endif
+
+    //True if the row's rank was seen holding an old row, in which case the next attempt waits for it to push the row.
+    bool fetched = false;
+    #ifdef EVENT_LOG
+        //True if the row was not fresh in the cache, even if another thread read it into the cache meanwhile.
+        bool missed = false;
+    #endif
+    #ifdef LOCKED_OPERATIONS
+    //The row is copied under a read lock of its slot. A thread that misses on another row with the same slot might replace the 
+    //row before the lock is taken, in which case it is read again.
+    while(true){
+    #endif
     while(rowData->age < min || rowData->row_id != row_id || rowData->table_id != table_id){ 
+        #ifdef EVENT_LOG
+            missed = true;
+        #endif
+        //Reading the row again before another rank advances would only return the same old row.
+        if(!fresh_row_may_exist(info, min)) wait_for_clocks(info, min);
+        if(fetched && info->wait_for_push && rank != info->id && rowData->row_id == row_id && rowData->table_id == table_id){
+            LOG_EVENT(LOG_PUSH_WAIT, row_id, table_id, rank, min);
+            r = wait_for_row_push(info, rowData, index, rank, min, &fetched); ERROR_CHECK;
+            if(!fetched) LOG_EVENT(LOG_PUSH_TIMEOUT, row_id, table_id, rank, min);
+            continue;
+        }
+        TRACE_SCOPE(TRACE_REMOTE_READ, row_id, table_id);
+        LOG_EVENT(LOG_REMOTE_READ, row_id, table_id, rank, min);
+        //Rows of other ranks go through the node cache, if ranks on the same host share one.
+        const bool through_node = info->cacheOpts.node_size && rank != info->id;
         #ifdef LOCKED_OPERATIONS
             //Lock row in cache. Prefetch responders will have to wait until this is done...
-            r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
-            ERROR_CHECK;
-            //Lock row in server for reading. Any new updates to that row will have to wait until read is done...
-            r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, offset + ROW_LOCK_OFFSET, rank);
-            ERROR_CHECK;
-            //This read will not wait for queue after posting request, since that will be done by write unlock.
-            PRINT_DEBUG_INTERNAL(" | : Reading...");
-            r = read(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, offset + ROW_METADATA_OFFSET, offset_cache + ROW_METADATA_OFFSET, 
-                     ROW_SIZE_IN_CACHE, rank);
-            ERROR_CHECK;
-            r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
-            ERROR_CHECK;
-            r = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, offset + ROW_LOCK_OFFSET, rank);
+            r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
             ERROR_CHECK;
+            //Another thread that missed on the same row might have read it into the slot while this one waited for the lock.
+            //If that row is fresh enough for this read, it is used instead of reading the row again.
+            if(rowData->age >= min && rowData->row_id == row_id && rowData->table_id == table_id){
+                PRINT_DEBUG_INTERNAL(" | : Row was read by another thread.");
+                r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
+                ERROR_CHECK;
+                break;
+            }
+            if(through_node){
+                //The node cache locks the row in server while reading it.
+                r = fetch_row_through_node(info, rank, index, slot, row_id, table_id, min);
+                ERROR_CHECK;
+                r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
+                ERROR_CHECK;
+            } else {
+                //Lock row in server for reading. Any new updates to that row will have to wait until read is done...
+                r = lock_row_for_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank);
+                ERROR_CHECK;
+                //This read will not wait for queue after posting request, since that will be done by write unlock.
+                PRINT_DEBUG_INTERNAL(" | : Reading...");
+                r = read_row_to_cache(info, rank, index, slot);
+                ERROR_CHECK;
+                r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
+                ERROR_CHECK;
+                r = unlock_row_from_read(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank);
+                ERROR_CHECK;
+            }
         #else
-            r = readwait(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, offset + ROW_METADATA_OFFSET, offset_cache + ROW_METADATA_OFFSET, 
-                         ROW_SIZE_IN_CACHE, rank);
+            //The slot might still be the source of a write that was not waited for.
+            r = wait_for_slot(info, slot);                      ERROR_CHECK;
+            TRACE_SCOPE(TRACE_WAIT, row_id, table_id);
+            if(through_node) r = fetch_row_through_node(info, rank, index, slot, row_id, table_id, min);
+            else r = fetch_row_to_cache(info, rank, index, slot);
             ERROR_CHECK;
         #endif
+        fetched = true;
     }    
+    #ifdef LOCKED_OPERATIONS
+        r = lock_row_for_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
+        ERROR_CHECK;
+        if(rowData->age >= min && rowData->row_id == row_id && rowData->table_id == table_id) break;
+        r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
+        ERROR_CHECK;
+    }
+    #endif
 
     PRINT_DEBUG_INTERNAL(" | : Read fresh row. Age was " << rowData->age);
+    LOG_EVENT(missed ? LOG_READ_MISS : LOG_READ_HIT, row_id, table_id, rank, rowData->age);
+
+    #ifdef READ_STATS
+        const unsigned long wait_ns = waited ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::steady_clock::now() - wait_begin).count() : 0;
+        record_read(info, table_id, rowData->age, wait_ns);
+    #endif
+
+    memcpy(row, (char*)cache + cache_data_offset(info, slot), info->row_size);
+    if(data) *data = *rowData;
 
     #ifdef LOCKED_OPERATIONS
-        r = lock_row_for_read(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
+        r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
         ERROR_CHECK;
     #endif
 
-    memcpy(row, (void*)((char*)rowData + ROW_DATA_OFFSET - ROW_METADATA_OFFSET), info->row_size);
-    if(data) *data = *rowData;
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_read_part(lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack, gaspi_size_t offset,
+                                   gaspi_size_t length, void* part, LazyGaspiRowData* data){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    PRINT_DEBUG_INTERNAL("Reading " << length << " bytes at offset " << offset << " of row " << row_id << " of table " 
+                         << table_id << "...");
+    TRACE_SCOPE(TRACE_READ, row_id, table_id);
+
+    #ifdef SAFETY_CHECKS
+    if(part == nullptr){
+        PRINT_ON_ERROR(" | Error: read part was called with part = nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(row_id >= info->table_size || table_id >= info->table_amount){
+        PRINT_ON_ERROR(" | Error: row/table ID was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    if(offset > info->row_size || length > info->row_size - offset){
+        PRINT_ON_ERROR(" | Error: part of the row was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    if(info->age == 0){
+        PRINT_ON_ERROR(" | Error: clock must be called at least once before read.");
+        return GASPI_ERR_NOINIT;
+    }
+    #endif
+
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+
+    gaspi_pointer_t cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+
+    const auto slot = get_offset_in_cache(info, row_id, table_id);
+    auto rowData = (RowTag*)((char*)cache + cache_tag_offset(info, slot));
+    if(rowData->age < min || rowData->row_id != row_id || rowData->table_id != table_id){
+        r = restore_kept_row(info, row_id, table_id, slot); ERROR_CHECK;
+    }
+
+    //A fresh row in the cache is used as is. With locks, it is checked again once its slot is locked, since a thread that misses on
+    //another row with the same slot might replace it meanwhile.
+    if(rowData->age >= min && rowData->row_id == row_id && rowData->table_id == table_id){
+        #ifdef LOCKED_OPERATIONS
+            r = lock_row_for_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id); ERROR_CHECK;
+        #endif
+        const RowTag tag = *rowData;
+        const bool cached = tag.age >= min && tag.row_id == row_id && tag.table_id == table_id;
+        if(cached){
+            PRINT_DEBUG_INTERNAL(" | Found row in cache.");
+            memcpy(part, (char*)cache + cache_data_offset(info, slot) + offset, length);
+            if(data) *data = tag;
+        }
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id); ERROR_CHECK;
+        #endif
+        if(cached){
+            #ifdef READ_STATS
+                record_read(info, table_id, tag.age, 0);
+            #endif
+            return GASPI_SUCCESS;
+        }
+    }
+
+    //Without a staging region, the whole row is read instead. Locks are taken per row, so the same is done with locks.
+    #ifndef LOCKED_OPERATIONS
+    if(get_staging_capacity(info) == 0)
+    #endif
+    {
+        std::vector<char> row(info->row_size);
+        r = lazygaspi_read(row_id, table_id, slack, row.data(), data); ERROR_CHECK;
+        memcpy(part, row.data() + offset, length);
+        return GASPI_SUCCESS;
+    }
+
+    #ifndef LOCKED_OPERATIONS
+
+    gaspi_rank_t rank;
+    gaspi_offset_t index;
+    std::tie(rank, index) = get_row_location(info, row_id, table_id);
+    if(info->auto_prefetch && rank != info->id) record_read_pattern(info, row_id, table_id, slack);
+
+    #ifdef READ_STATS
+        const auto wait_begin = std::chrono::steady_clock::now();
+    #endif
+
+    //The part is read into the staging region, since the rest of the cached row would not be as fresh as the part.
+    const gaspi_offset_t k = 0;
+    auto tag = (RowTag*)((char*)cache + staging_tag_offset(info, k));
+    while(true){
+        if(!fresh_row_may_exist(info, min)) wait_for_clocks(info, min);
+        //The staging region is only held for one attempt, so that a part that is still too old does not keep other threads from it.
+        std::lock_guard<std::mutex> staging_lock(*staging_mutex);
+        r = wait_for_staging(info, k); ERROR_CHECK;
+        {
+            TRACE_SCOPE(TRACE_REMOTE_READ, row_id, table_id);
+            TRACE_SCOPE(TRACE_WAIT, row_id, table_id);
+            r = fetch_part_to_staging(info, rank, index, k, offset, length); ERROR_CHECK;
+        }
+        if(tag->age < min || tag->row_id != row_id || tag->table_id != table_id) continue;
+
+        PRINT_DEBUG_INTERNAL(" | : Read fresh part. Age was " << tag->age);
+
+        #ifdef READ_STATS
+            record_read(info, table_id, tag->age, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                  std::chrono::steady_clock::now() - wait_begin).count());
+        #endif
+
+        memcpy(part, (char*)cache + staging_data_offset(info, k) + offset, length);
+        if(data) *data = *tag;
+        return GASPI_SUCCESS;
+    }
+    #endif
+}
+
+#ifndef LOCKED_OPERATIONS
+/** Finds the rows of a run of `run` entries of `rank`, starting at entry `index` (row `first_row`), whose cached copy is fresh and
+ *  no older than the modification age of its block, so that it does not have to be transferred again. The modification ages are
+ *  only fetched if the cache holds a fresh copy of one of the rows.
+ * 
+ *  Parameters:
+ *  use_cached - Output parameter. Set to `run` flags, which are true for the rows found.
+ *  modified   - Buffer for the modification ages.
+ */
+static gaspi_return_t find_latest_cached(LazyGaspiProcessInfo* info, char* cache, gaspi_rank_t rank, gaspi_offset_t index,
+                                         lazygaspi_id_t table_id, lazygaspi_id_t first_row, gaspi_offset_t run, lazygaspi_age_t min,
+                                         std::vector<char>& use_cached, std::vector<lazygaspi_age_t>& modified){
+    use_cached.assign(run, false);
+    bool any = false;
+    for(gaspi_offset_t k = 0; k < run; k++){
+        auto tag = (RowTag*)(cache + cache_tag_offset(info, get_offset_in_cache(info, first_row + k, table_id)));
+        use_cached[k] = tag->age >= min && tag->row_id == first_row + k && tag->table_id == table_id;
+        any |= use_cached[k];
+    }
+    if(!any) return GASPI_SUCCESS;
+
+    const auto first_block = index / MODIFIED_BLOCK_ROWS;
+    modified.resize((index + run - 1) / MODIFIED_BLOCK_ROWS - first_block + 1);
+    auto r = fetch_modified_ages(info, rank, first_block, modified.size(), modified.data()); ERROR_CHECK;
+    for(gaspi_offset_t k = 0; k < run; k++) if(use_cached[k]){
+        auto tag = (RowTag*)(cache + cache_tag_offset(info, get_offset_in_cache(info, first_row + k, table_id)));
+        use_cached[k] = tag->age >= modified[(index + k) / MODIFIED_BLOCK_ROWS - first_block];
+    }
+    return GASPI_SUCCESS;
+}
+#endif
+
+gaspi_return_t lazygaspi_read_range(lazygaspi_id_t table_id, lazygaspi_id_t first, lazygaspi_id_t count, lazygaspi_slack_t slack,
+                                    void* rows, LazyGaspiRowData* data){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    PRINT_DEBUG_INTERNAL("Reading " << count << " rows of table " << table_id << ", starting at row " << first << "...");
+    TRACE_SCOPE(TRACE_READ, first, table_id);
+
+    #ifdef SAFETY_CHECKS
+    if(rows == nullptr){
+        PRINT_ON_ERROR(" | Error: read range was called with rows = nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(table_id >= info->table_amount || first > info->table_size || count > info->table_size - first){
+        PRINT_ON_ERROR(" | Error: table ID or row range was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    if(info->age == 0){
+        PRINT_ON_ERROR(" | Error: clock must be called at least once before read.");
+        return GASPI_ERR_NOINIT;
+    }
+    #endif
 
     #ifdef LOCKED_OPERATIONS
-        r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
+    //Locks are taken per row, so rows are read one at a time.
+    for(lazygaspi_id_t i = 0; i < count; i++){
+        r = lazygaspi_read(first + i, table_id, slack, (char*)rows + i * info->row_size, data ? data + i : nullptr);
         ERROR_CHECK;
+    }
+    return GASPI_SUCCESS;
+    #else
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+    const auto capacity = get_staging_capacity(info);
+
+    gaspi_pointer_t cache, rows_table = nullptr;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+    if(get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts)) {
+        r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows_table); ERROR_CHECK;
+    }
+
+    gaspi_rank_t rank;
+    gaspi_offset_t index;
+    //Per row of a run: whether its cached copy is used instead of a transferred one.
+    std::vector<char> use_cached;
+    std::vector<lazygaspi_age_t> modified;
+    //Per row of a run: whether it is read again with lazygaspi_read.
+    std::vector<char> read_again;
+    for(lazygaspi_id_t i = 0; i < count; ){
+        std::tie(rank, index) = get_row_location(info, first + i, table_id);
+
+        //Rows stored by the current rank are checked in place. Others are staged in runs of contiguous entries of their rank.
+        const bool local = rank == info->id;
+        gaspi_offset_t run = 1, staged_first = 0, staged_count = 0;
+        use_cached.assign(1, false);
+        #ifdef READ_STATS
+            unsigned long staged_wait_ns = 0;
+        #endif
+        std::unique_lock<std::mutex> staging_lock(*staging_mutex, std::defer_lock);
+        if(!local && capacity){
+            while(i + run < count && run < capacity && get_row_location(info, first + i + run, table_id) == 
+                  std::make_pair(rank, index + run)) run++;
+
+            staging_lock.lock();
+            //Partial writes might still be sent from the staging region.
+            r = wait_for_staging(info); ERROR_CHECK;
+            r = find_latest_cached(info, (char*)cache, rank, index, table_id, first + i, run, min, use_cached, modified); 
+            ERROR_CHECK;
+            //Only the rows between the first and the last one that are not taken from the cache are staged.
+            staged_first = run;
+            for(gaspi_offset_t k = 0; k < run; k++) if(!use_cached[k]){
+                if(staged_first == run) staged_first = k;
+                staged_count = k - staged_first + 1;
+            }
+
+            if(staged_count){
+                PRINT_DEBUG_INTERNAL(" | Staging " << staged_count << " rows from rank " << rank << ", starting at entry " 
+                                     << index + staged_first << "...");
+                TRACE_SCOPE(TRACE_REMOTE_READ, first + i, table_id);
+                TRACE_SCOPE(TRACE_WAIT, first + i, table_id);
+                #ifdef READ_STATS
+                    const auto wait_begin = std::chrono::steady_clock::now();
+                #endif
+                r = fetch_rows_to_staging(info, rank, index + staged_first, staged_count); ERROR_CHECK;
+                #ifdef READ_STATS
+                    staged_wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - wait_begin).count();
+                #endif
+            }
+        }
+
+        read_again.assign(run, false);
+        for(gaspi_offset_t k = 0; k < run; k++){
+            const auto row_id = first + i + k;
+            auto row = (char*)rows + (i + k) * info->row_size;
+            const RowTag* tag = nullptr;
+            const char* source = nullptr;
+            if(local){
+                tag = (RowTag*)((char*)rows_table + rows_tag_offset(info, index + k));
+                source = (char*)rows_table + rows_data_offset(info, index + k);
+            } else if(use_cached[k]){
+                const auto slot = get_offset_in_cache(info, row_id, table_id);
+                tag = (RowTag*)((char*)cache + cache_tag_offset(info, slot));
+                source = (char*)cache + cache_data_offset(info, slot);
+            } else if(capacity){
+                tag = (RowTag*)((char*)cache + staging_tag_offset(info, k - staged_first));
+                source = (char*)cache + staging_data_offset(info, k - staged_first);
+            }
+            if(tag == nullptr || tag->age < min || tag->row_id != row_id || tag->table_id != table_id){
+                read_again[k] = true;
+                continue;
+            }
+            memcpy(row, source, info->row_size);
+            if(data) data[i + k] = *tag;
+            #ifdef READ_STATS
+                //Rows read again below are recorded by lazygaspi_read.
+                record_read(info, table_id, tag->age, local || use_cached[k] ? 0 : staged_wait_ns);
+            #endif
+        }
+
+        //Only rows that were still too old (or that could not be staged) are read again, one at a time, without holding the
+        //staging region, since they might wait for other ranks.
+        if(staging_lock.owns_lock()) staging_lock.unlock();
+        for(gaspi_offset_t k = 0; k < run; k++, i++) if(read_again[k]){
+            r = lazygaspi_read(first + i, table_id, slack, (char*)rows + i * info->row_size, data ? data + i : nullptr);
+            ERROR_CHECK;
+        }
+    }
+    return GASPI_SUCCESS;
     #endif
+}
 
+gaspi_return_t lazygaspi_read_table(lazygaspi_id_t table_id, lazygaspi_slack_t slack, void* rows, LazyGaspiRowData* data){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+    return lazygaspi_read_range(table_id, 0, info->table_size, slack, rows, data);
+}
+
+gaspi_return_t lazygaspi_check_fresh(const lazygaspi_id_t* row_vec, const lazygaspi_id_t* table_vec, size_t size, 
+                                     lazygaspi_slack_t slack, uint64_t* bitmap){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    PRINT_DEBUG_INTERNAL("Checking freshness of " << size << " rows in cache...");
+
+    #ifdef SAFETY_CHECKS
+    if(size && (row_vec == nullptr || table_vec == nullptr || bitmap == nullptr)){
+        PRINT_ON_ERROR(" | Error: check_fresh was called with a nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(info->age == 0){
+        PRINT_ON_ERROR(" | Error: clock must be called at least once before checking freshness.");
+        return GASPI_ERR_NOINIT;
+    }
+    for(size_t i = 0; i < size; i++) if(row_vec[i] >= info->table_size || table_vec[i] >= info->table_amount){
+        PRINT_ON_ERROR(" | Error: row/table ID was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    #endif
+
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+
+    gaspi_pointer_t cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+
+    //Tags are gathered into contiguous arrays one bitmap word at a time, so that the comparisons below can be vectorized.
+    lazygaspi_age_t ages[64];
+    lazygaspi_id_t rows[64], tables[64];
+    for(size_t word = 0; word * 64 < size; word++){
+        const size_t first = word * 64;
+        const size_t amount = (size - first < 64) ? size - first : 64;
+
+        for(size_t i = 0; i < amount; i++){
+            const auto tag = (RowTag*)((char*)cache + cache_tag_offset(info, 
+                              get_offset_in_cache(info, row_vec[first + i], table_vec[first + i])));
+            ages[i] = tag->age;
+            rows[i] = tag->row_id;
+            tables[i] = tag->table_id;
+        }
+
+        uint64_t bits = 0;
+        for(size_t i = 0; i < amount; i++)
+            bits |= (uint64_t)((ages[i] >= min) & (rows[i] == row_vec[first + i]) & (tables[i] == table_vec[first + i])) << i;
+        bitmap[word] = bits;
+    }
+
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_get_read_histogram(lazygaspi_id_t table_id, LazyGaspiReadHistogram* histogram){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    if(info->histograms == nullptr){
+        PRINT_ON_ERROR("Read histograms are only collected if library is compiled with READ_STATS.");
+        return GASPI_ERR_NOINIT;
+    }
+    if(histogram == nullptr){
+        PRINT_ON_ERROR("Tried to get read histogram with nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(table_id >= info->table_amount){
+        PRINT_ON_ERROR("Table ID was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+
+    const auto& source = info->histograms[table_id];
+    for(int i = 0; i < LAZYGASPI_STALENESS_BUCKETS; i++)
+        histogram->staleness[i] = __atomic_load_n(&source.staleness[i], __ATOMIC_RELAXED);
+    for(int i = 0; i < LAZYGASPI_WAIT_BUCKETS; i++) histogram->wait[i] = __atomic_load_n(&source.wait[i], __ATOMIC_RELAXED);
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_reset_read_histograms(){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    if(info->histograms == nullptr){
+        PRINT_ON_ERROR("Read histograms are only collected if library is compiled with READ_STATS.");
+        return GASPI_ERR_NOINIT;
+    }
+    for(lazygaspi_id_t t = 0; t < info->table_amount; t++){
+        auto& histogram = info->histograms[t];
+        for(int i = 0; i < LAZYGASPI_STALENESS_BUCKETS; i++) __atomic_store_n(&histogram.staleness[i], 0, __ATOMIC_RELAXED);
+        for(int i = 0; i < LAZYGASPI_WAIT_BUCKETS; i++) __atomic_store_n(&histogram.wait[i], 0, __ATOMIC_RELAXED);
+    }
     return GASPI_SUCCESS;
 }
@@ -0,0 +1,150 @@
+#include "lazygaspi_hs.h"
+#include "gaspi_utils.h"
+#include "utils.h"
+#include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+//Default values
+#define THREADS 4
+#define ITERATIONS 10
+#define SLACK 0
+
+void print_usage();
+
+/** The value of element `j` of a row written in age `age`, so that a reader can tell from a row's tag what its data must be. */
+inline uint64_t expected(lazygaspi_id_t row, lazygaspi_id_t table, lazygaspi_age_t age, gaspi_size_t j,
+                         lazygaspi_id_t table_size, lazygaspi_id_t table_amount){
+    return ((age * table_amount + table) * table_size + row) * 31 + j;
+}
+
+/** Checks a row (or the elements [first, first + length) of it) against its tag. Returns true if they match. */
+bool check(const uint64_t* values, const LazyGaspiRowData& tag, lazygaspi_id_t row, lazygaspi_id_t table, gaspi_size_t first,
+           gaspi_size_t length, lazygaspi_age_t min, LazyGaspiProcessInfo* info){
+    if(tag.row_id != row || tag.table_id != table || tag.age < min) return false;
+    for(gaspi_size_t j = 0; j < length; j++)
+        if(values[j] != expected(row, table, tag.age, first + j, info->table_size, info->table_amount)) return false;
+    return true;
+}
+
+/** Reads every row of every table with lazygaspi_read, lazygaspi_read_part and lazygaspi_read_table, starting at a different
+ *  row on each thread, and counts the rows whose data does not match their tag. */
+void read_all(LazyGaspiProcessInfo* info, unsigned int thread, unsigned int threads, lazygaspi_slack_t slack,
+              std::atomic<unsigned long>* bad){
+    const gaspi_size_t length = info->row_size / sizeof(uint64_t);
+    const auto min = get_min_age(info->age, slack, info->offset_slack);
+    //The part is the second half of the row, so that it does not start with it.
+    const gaspi_size_t part_first = length / 2, part_length = length - length / 2;
+    std::vector<uint64_t> row(length), rows(length * info->table_size);
+    std::vector<LazyGaspiRowData> tags(info->table_size);
+    LazyGaspiRowData tag;
+    unsigned long missed = 0;
+
+    for(lazygaspi_id_t table = 0; table < info->table_amount; table++){
+        for(lazygaspi_id_t k = 0; k < info->table_size; k++){
+            const auto id = (k + thread * info->table_size / threads) % info->table_size;
+            //The part is read first, so that it is not taken from the cache.
+            SUCCESS_OR_DIE(lazygaspi_read_part(id, table, slack, part_first * sizeof(uint64_t), part_length * sizeof(uint64_t),
+                                               row.data(), &tag));
+            if(!check(row.data(), tag, id, table, part_first, part_length, min, info)) missed++;
+            SUCCESS_OR_DIE(lazygaspi_read(id, table, slack, row.data(), &tag));
+            if(!check(row.data(), tag, id, table, 0, length, min, info)) missed++;
+        }
+        SUCCESS_OR_DIE(lazygaspi_read_table(table, slack, rows.data(), tags.data()));
+        for(lazygaspi_id_t id = 0; id < info->table_size; id++)
+            if(!check(rows.data() + id * length, tags[id], id, table, 0, length, min, info)) missed++;
+    }
+    *bad += missed;
+}
+
+int main(int argc, char** argv){
+    int                 ch;
+    lazygaspi_slack_t   slack = SLACK;
+    lazygaspi_id_t      table_size = 0, table_amount = 0;
+    gaspi_size_t        row_length = 0, cache_size = 0;
+    unsigned int        threads = THREADS, iterations = ITERATIONS;
+
+    while((ch = getopt(argc, argv, "hk:n:r:c:t:i:s:")) != -1) {
+        switch(ch){
+            case 'k': table_size = atol(optarg); break;
+            case 'n': table_amount = atol(optarg); break;
+            case 'r': row_length = atol(optarg); break;
+            case 'c': cache_size = atol(optarg); break;
+            case 't': threads = atol(optarg); break;
+            case 'i': iterations = atol(optarg); break;
+            case 's': slack = atol(optarg); break;
+            case '?':
+            case ':':
+            default : print_usage(); exit(EXIT_FAILURE);
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+        }
+    }
+
+    if(table_size == 0 || table_amount == 0 || row_length == 0 || threads == 0 || iterations == 0){
+        print_usage(); exit(EXIT_FAILURE);
+    }
+
+    //Without locks, threads must not read rows that share a slot of the cache at the same time, so the cache holds all rows.
+    if(cache_size == 0){
+        #ifdef LOCKED_OPERATIONS
+            cache_size = table_size;
+        #else
+            cache_size = table_size * table_amount;
+        #endif
+    }
+    SUCCESS_OR_DIE_COUT(lazygaspi_init(table_amount, table_size, row_length * sizeof(uint64_t), ShardingOptions(0),
+                                       CachingOptions(LAZYGASPI_HS_HASH_ROW, cache_size)));
+
+    LazyGaspiProcessInfo* info;
+    SUCCESS_OR_DIE_COUT(lazygaspi_get_info(&info));
+    SUCCESS_OR_DIE(lazygaspi_set_max_threads(threads));
+
+    std::vector<uint64_t> row(row_length);
+    std::atomic<unsigned long> bad(0);
+
+    for(unsigned int it = 0; it < iterations; it++){
+        SUCCESS_OR_DIE(lazygaspi_clock());
+        for(lazygaspi_id_t table = 0; table < table_amount; table++)
+        for(lazygaspi_id_t id = info->id; id < table_size; id += info->n){
+            for(gaspi_size_t j = 0; j < row_length; j++) row[j] = expected(id, table, info->age, j, table_size, table_amount);
+            SUCCESS_OR_DIE(lazygaspi_write(id, table, row.data()));
+        }
+        //Rows are only read once all ranks wrote them, and written again once all ranks read them, so that no read sees a row
+        //that is being written.
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+
+        std::vector<std::thread> readers;
+        for(unsigned int t = 0; t < threads; t++) readers.emplace_back(read_all, info, t, threads, slack, &bad);
+        for(auto& reader : readers) reader.join();
+
+        SUCCESS_OR_DIE(GASPI_BARRIER);
+    }
+
+    unsigned long local = bad, total;
+    SUCCESS_OR_DIE(gaspi_allreduce(&local, &total, 1, GASPI_OP_SUM, GASPI_TYPE_ULONG, GASPI_GROUP_ALL, GASPI_BLOCK));
+    if(info->id == 0) std::cout << "Rows that did not match their tag: " << total << std::endl;
+
+    SUCCESS_OR_DIE(lazygaspi_term());
+
+    return total ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+void print_usage(){
+    std::cout << "Usage: gaspi_run <...args...> -k <rows_per_table> -n <amount_of_tables> -r <row_size> [OPTIONS]\n\n"
+              << "Parameters:\n"
+              << "  -k <rows_per_table>:    The amount of rows in one table.\n"
+              << "  -n <amount_of_tables>:  The total amount of tables.\n"
+              << "  -r <row_size>:          The amount of 64-bit values in a single row.\n"
+              << "  [-c <cache_size>]:      The size of the cache, in rows. Default is all rows, or one table if the library was\n"
+              << "                          compiled with locks, so that threads read rows that share a slot of the cache.\n"
+              << "  [-t <threads>]:         The amount of threads that read at the same time. Default is " << THREADS << ".\n"
+              << "  [-i <iterations>]:      The amount of iterations. Default is " << ITERATIONS << ".\n"
+              << "  [-s <slack>]:           The slack of reads. Default is " << SLACK << ".\n\n"
+              << "Each rank writes its rows, and then reads all rows of all tables from several threads at once, with "
+              << "lazygaspi_read, lazygaspi_read_part and lazygaspi_read_table. Every row read is checked against its tag.\n"
+              << std::endl;
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Runs the LazyGASPI microbenchmarks on the current node over a sweep of parameters and writes all results to a JSON array.
+# Sweeps can be changed through the environment, for example:
+#   RANKS="2 4" ROW_SIZES="64 4096" ./run_bench.sh results.json
+# A block or cache size of 0 means one table. For MPI builds, use LAUNCHER="mpirun -hostfile".
+
+cd $(dirname $0)
+OUT=${1:-bench_results.json}
+RANKS=${RANKS:-"1 2 4"}
+ROW_SIZES=${ROW_SIZES:-"8 64 512 4096"}
+BLOCK_SIZES=${BLOCK_SIZES:-"1 16 0"}
+CACHE_SIZES=${CACHE_SIZES:-"16 0"}
+TABLE_SIZE=${TABLE_SIZE:-64}
+TABLE_AMOUNT=${TABLE_AMOUNT:-4}
+ITERATIONS=${ITERATIONS:-10}
+LAUNCHER=${LAUNCHER:-"gaspi_run -m"}
+MACHINEFILE=.bench_machinefile
+RESULTS=.bench_results
+
+rm -f $RESULTS
+for n in $RANKS; do
+    rm -f $MACHINEFILE
+    for i in $(seq $n); do hostname >> $MACHINEFILE; done
+    for r in $ROW_SIZES; do
+    for b in $BLOCK_SIZES; do
+    for c in $CACHE_SIZES; do
+        $LAUNCHER $MACHINEFILE $(pwd)/bench -k $TABLE_SIZE -n $TABLE_AMOUNT -r $r -b $b -c $c -i $ITERATIONS \
+            | grep '^{' >> $RESULTS
+    done
+    done
+    done
+done
+
+echo "[" > $OUT
+sed '$!s/$/,/' $RESULTS >> $OUT
+echo "]" >> $OUT
+rm -f $RESULTS $MACHINEFILE
+echo "Results written to $OUT"
@@ -0,0 +1,80 @@
+#ifdef TRACE
+
+#include "trace.h"
+#include "gaspi_utils.h"
+
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+static const char* trace_event_names[TRACE_EVENT_TYPE_AMOUNT] = {
+    "read", "remote_read", "wait", "lock_spin", "write", "prefetch", "fulfill_scan", "clock"
+};
+
+static_assert((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0, "TRACE_BUFFER_SIZE must be a power of 2.");
+
+static TraceEvent* trace_buffer = nullptr;
+static std::atomic<uint64_t> trace_head(0);
+static std::atomic<uint32_t> trace_threads(0);
+static gaspi_rank_t trace_rank;
+
+uint64_t trace_now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+gaspi_return_t trace_init(gaspi_rank_t rank){
+    trace_rank = rank;
+    trace_buffer = new (std::nothrow) TraceEvent[TRACE_BUFFER_SIZE];
+    if(trace_buffer == nullptr){
+        PRINT_ON_ERROR_COUT("Failed to allocate trace buffer.");
+        return GASPI_ERR_MEMALLOC;
+    }
+    trace_head = 0;
+    return GASPI_SUCCESS;
+}
+
+void trace_record(TraceEventType type, uint64_t begin, lazygaspi_id_t row_id, lazygaspi_id_t table_id){
+    static thread_local uint32_t thread = trace_threads++;
+    if(trace_buffer == nullptr) return;
+    const auto end = trace_now();
+    auto& event = trace_buffer[trace_head.fetch_add(1, std::memory_order_relaxed) & (TRACE_BUFFER_SIZE - 1)];
+    event.begin = begin;
+    event.end = end;
+    event.row_id = row_id;
+    event.table_id = table_id;
+    event.thread = thread;
+    event.type = type;
+}
+
+gaspi_return_t trace_dump(){
+    if(trace_buffer == nullptr) return GASPI_SUCCESS;
+
+    auto s = std::stringstream();
+    s << "lazygaspi_trace_" << trace_rank << ".json";
+    std::ofstream out(s.str());
+    if(!out){
+        PRINT_ON_ERROR_COUT("Failed to open " << s.str());
+        return GASPI_ERROR;
+    }
+
+    const uint64_t head = trace_head;
+    const uint64_t first = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+    out << "[\n";
+    for(auto i = first; i < head; i++){
+        const auto& event = trace_buffer[i & (TRACE_BUFFER_SIZE - 1)];
+        out << "{\"name\":\"" << trace_event_names[event.type] << "\",\"ph\":\"X\",\"pid\":" << trace_rank 
+            << ",\"tid\":" << event.thread << ",\"ts\":" << event.begin / 1000 << '.' << (event.begin / 100) % 10
+            << ",\"dur\":" << (event.end - event.begin) / 1000.0 
+            << ",\"args\":{\"row\":" << event.row_id << ",\"table\":" << event.table_id << "}}"
+            << (i + 1 < head ? ",\n" : "\n");
+    }
+    out << "]\n";
+
+    delete[] trace_buffer;
+    trace_buffer = nullptr;
+    return GASPI_SUCCESS;
+}
+
+#endif
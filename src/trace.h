@@ -0,0 +1,55 @@
+/** Operation tracer for LazyGASPI. Only compiled with TRACE (see configure.sh). 
+ *  Every traced operation is stored as a begin/end pair of timestamps in a per-rank ring buffer, which is dumped by 
+ *  `lazygaspi_term` as a Chrome trace (viewable in chrome://tracing or ui.perfetto.dev). When the buffer is full, the oldest
+ *  events are overwritten. */
+
+#ifndef __H_TRACE
+#define __H_TRACE
+
+#include <GASPI.h>
+#include <cstdint>
+
+#include "lazygaspi_hs.h"
+
+//Amount of events kept by the ring buffer. Must be a power of 2.
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE (1 << 16)
+#endif
+
+enum TraceEventType : uint8_t {
+    TRACE_READ, TRACE_REMOTE_READ, TRACE_WAIT, TRACE_LOCK_SPIN, TRACE_WRITE, TRACE_PREFETCH, TRACE_FULFILL_SCAN, TRACE_CLOCK,
+    TRACE_EVENT_TYPE_AMOUNT
+};
+
+struct TraceEvent{
+    uint64_t begin, end;
+    lazygaspi_id_t row_id, table_id;
+    uint32_t thread;
+    TraceEventType type;
+};
+
+/** Returns the amount of nanoseconds since epoch. Timestamps of different ranks are only comparable if their clocks are 
+ *  synchronized. */
+uint64_t trace_now();
+
+/** Allocates the ring buffer of the current rank. Called by `lazygaspi_init`. */
+gaspi_return_t trace_init(gaspi_rank_t rank);
+
+/** Stores an event in the ring buffer. Lock-free and safe to call from multiple threads. */
+void trace_record(TraceEventType type, uint64_t begin, lazygaspi_id_t row_id, lazygaspi_id_t table_id);
+
+/** Writes the ring buffer to `lazygaspi_trace_<rank>.json` and frees it. Called by `lazygaspi_term`. */
+gaspi_return_t trace_dump();
+
+/** Records an event from its construction until its destruction. */
+struct TraceScope{
+    TraceEventType type;
+    uint64_t begin;
+    lazygaspi_id_t row_id, table_id;
+
+    TraceScope(TraceEventType type, lazygaspi_id_t row_id = 0, lazygaspi_id_t table_id = 0) : 
+               type(type), begin(trace_now()), row_id(row_id), table_id(table_id) {}
+    ~TraceScope(){ trace_record(type, begin, row_id, table_id); }
+};
+
+#endif
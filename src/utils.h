@@ -9,8 +9,13 @@
 #include <iostream>
 #include <thread>
 #include <utility>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
 
 #include "lazygaspi_hs.h"
+#include "gaspi_utils.h"
 
 typedef unsigned int uint;
 typedef unsigned char byte;
@@ -19,7 +24,20 @@ typedef unsigned long ulong;
 #define subsizeof(STRUCT, MEMBER_BEGIN, MEMBER_END) (offsetof(STRUCT, MEMBER_END) + sizeof(decltype(std::declval<STRUCT>().MEMBER_END)) - offsetof(STRUCT, MEMBER_BEGIN))
 #define sizeofmember(STRUCT, MEMBER) sizeof((( STRUCT *)0)-> MEMBER)
 
+//Notification of the rows segment, sent whenever a row or a prefetch request is written to it.
 #define NOTIF_ID_ROW_WRITTEN 0
+//Notification of the cache segment, sent whenever a rank pushes a requested row to it.
+#define NOTIF_ID_ROW_PUSHED 0
+//Notifications of the cache and node cache segments, set when a read of rows (tags, and data with SOA_LAYOUT or for a part of a 
+//row) into them completes. They are split into NOTIF_ROWS_READ_RANGES ranges of two ID's, and each read holds a range of its own 
+//(see ReadNotifications) until it was waited for, so that reads of different threads do not take each other's notifications.
+#define NOTIF_ID_ROWS_READ 1
+#define NOTIF_ROWS_READ_RANGES 64
+#ifdef SOA_LAYOUT
+    #define NOTIF_ROWS_READ_AMOUNT 2
+#else
+    #define NOTIF_ROWS_READ_AMOUNT 1
+#endif
 
 #if (defined (DEBUG) || defined (DEBUG_INTERNAL))
 #define PRINT_DEBUG_INTERNAL(msg) *info->out << msg << std::endl
@@ -49,14 +67,66 @@ typedef unsigned long ulong;
 #define PRINT_DEBUG_COUT(msg)
 #endif
 
+#ifdef TRACE
+#include "trace.h"
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+//Traces the enclosing scope. Parameters are the event type and, optionally, the row and table ID's.
+#define TRACE_SCOPE(args...) TraceScope TRACE_CONCAT(__trace_scope_, __LINE__)(args)
+#else
+#define TRACE_SCOPE(args...) do{}while(0)
+#endif
+
+#ifdef EVENT_LOG
+#include "event_log.h"
+//Logs an event. The meaning of the rank and age depends on the event (see event_log.h).
+#define LOG_EVENT(event, row_id, table_id, rank, age) event_log_record(event, row_id, table_id, rank, age)
+#else
+#define LOG_EVENT(event, row_id, table_id, rank, age) do{}while(0)
+#endif
+
 #ifdef WITH_MPI
 #include <mpi.h>
 #define ERROR_MPI_CHECK_COUT(msg) {if(ret != MPI_SUCCESS){ std::cout << "Error " << ret << " at [" << __FILE__ << ':' << __LINE__ << "] \
                               from MPI: " << msg << std::endl; return GASPI_ERROR; }}
 #endif
 
-#define ROW_SIZE_IN_TABLE (sizeof(LazyGaspiRowData) + info->row_size + info->n * sizeof(lazygaspi_age_t))
-#define ROW_SIZE_IN_CACHE (sizeof(LazyGaspiRowData) + info->row_size)
+#define CACHE_LINE_SIZE 64
+
+//Alignment, in bytes, of the row data in the rows and cache segments. Can be set through configure.sh (--row-alignment).
+#ifndef ROW_ALIGNMENT
+    #define ROW_ALIGNMENT 1
+#endif
+static_assert(ROW_ALIGNMENT > 0 && (ROW_ALIGNMENT & (ROW_ALIGNMENT - 1)) == 0, "ROW_ALIGNMENT must be a power of 2.");
+
+#ifdef SOA_LAYOUT
+    #define DATA_ALIGNMENT (ROW_ALIGNMENT > CACHE_LINE_SIZE ? ROW_ALIGNMENT : CACHE_LINE_SIZE)
+#else
+    #define DATA_ALIGNMENT ROW_ALIGNMENT
+#endif
+//Locks and request ages are targets of atomic operations, so entries are never less aligned than an atomic value.
+#define ENTRY_ALIGNMENT (DATA_ALIGNMENT > sizeof(gaspi_atomic_value_t) ? DATA_ALIGNMENT : sizeof(gaspi_atomic_value_t))
+
+/** Rounds `size` up to the next multiple of `alignment`, which must be a power of 2. */
+static inline gaspi_size_t align_up(gaspi_size_t size, gaspi_size_t alignment){
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+#ifdef SOA_LAYOUT
+    //Compact metadata tag kept in the tag regions of the rows and cache segments. Four fit in one cache line.
+    struct RowTag{
+        lazygaspi_age_t age;
+        uint32_t row_id;
+        uint32_t table_id;
+
+        RowTag(lazygaspi_age_t age, lazygaspi_id_t row_id, lazygaspi_id_t table_id) : 
+               age(age), row_id((uint32_t)row_id), table_id((uint32_t)table_id) {}
+        RowTag() : RowTag(0, 0, 0) {}
+        operator LazyGaspiRowData() const { return LazyGaspiRowData(age, row_id, table_id); }
+    };
+#else
+    typedef LazyGaspiRowData RowTag;
+#endif
 
 #ifdef LOCKED_OPERATIONS
     #define LOCK_MASK_WRITE (((gaspi_atomic_value_t)1) << (sizeof(gaspi_atomic_value_t) * 8 - 1))
@@ -73,19 +143,434 @@ typedef unsigned long ulong;
     gaspi_return_t unlock_row_from_write(LazyGaspiProcessInfo* info, const gaspi_segment_id_t seg, const gaspi_offset_t offset,
                            const gaspi_rank_t rank, const gaspi_queue_id_t q = 0, bool wait_on_q = true);
 
-    #define ROW_LOCK_OFFSET 0
-    #define ROW_METADATA_OFFSET (ROW_LOCK_OFFSET + sizeof(Lock))
-    #define ROW_SIZE_IN_TABLE_WITH_LOCK (ROW_SIZE_IN_TABLE + sizeof(Lock))
-    #define ROW_SIZE_IN_CACHE_WITH_LOCK (ROW_SIZE_IN_CACHE + sizeof(Lock))
+    #define LOCK_SIZE sizeof(Lock)
+#else
+    #define LOCK_SIZE 0
+#endif
+
+/*  Instances (see lazygaspi_use_instance). State that a module keeps outside of the segments is kept once per instance, in a
+ *  PerInstance, which hands out the state of the current instance.
+ */
+template<typename T> class PerInstance{
+    T states[std::numeric_limits<gaspi_segment_id_t>::max() / LAZYGASPI_INSTANCE_SEGMENTS + 1];
+public:
+    T& operator*(){ return states[lazygaspi_current_instance / LAZYGASPI_INSTANCE_SEGMENTS]; }
+    T* operator->(){ return &**this; }
+};
+
+/** The amount of instances that were initialized and not terminated yet. GASPI is initialized with the first of them and 
+ *  terminated with the last. Only changed while holding instance_mutex. Defined in init.cpp. */
+extern unsigned int instance_amount;
+/** Held by lazygaspi_init and lazygaspi_term, so that threads that initialize or terminate different instances at the same time
+ *  do not both initialize or terminate GASPI. Defined in init.cpp. */
+extern std::mutex instance_mutex;
+
+/*  Completion tracking. gaspi_wait waits for everything posted to a queue, so a transfer whose source must not change until it 
+ *  completes takes a ticket once it is posted, and whoever changes the source next only waits if that ticket is not complete 
+ *  yet. Completion is only tracked per queue, not per transfer: a ticket is complete once a call to wait_for_queue for its 
+ *  queue that started after the ticket was taken has returned, so waiting for a ticket may also wait for later transfers on 
+ *  the same queue. The counters are atomic and may be used by several threads at once. Defined in completion.cpp.
+ */
+typedef unsigned long Ticket;
+
+/** Returns the ticket of the last transfer posted to queue `q`. */
+Ticket take_ticket(gaspi_queue_id_t q = 0);
+/** Waits for everything posted to queue `q`, which completes all tickets taken for it. */
+gaspi_return_t wait_for_queue(gaspi_queue_id_t q = 0);
+gaspi_return_t wait_for_ticket(Ticket ticket, gaspi_queue_id_t q = 0);
+/** Sets the ticket of the last transfer from a slot of the local cache. It must be taken for queue 0. */
+void set_slot_ticket(const LazyGaspiProcessInfo* info, gaspi_offset_t slot, Ticket ticket);
+/** Waits until a slot of the local cache can be changed. */
+gaspi_return_t wait_for_slot(const LazyGaspiProcessInfo* info, gaspi_offset_t slot);
+/** Sets the ticket of the last transfer from entry `k` of the staging region. It must be taken for queue 0. */
+void set_staging_ticket(const LazyGaspiProcessInfo* info, gaspi_offset_t k, Ticket ticket);
+/** Waits until entry `k` of the staging region can be changed. */
+gaspi_return_t wait_for_staging(const LazyGaspiProcessInfo* info, gaspi_offset_t k);
+/** Waits until all entries of the staging region can be changed. */
+gaspi_return_t wait_for_staging(const LazyGaspiProcessInfo* info);
+/** Waits until LazyGaspiProcessInfo::communicator can be changed, and sets it. */
+gaspi_return_t set_communicator(LazyGaspiProcessInfo* info, lazygaspi_age_t value);
+/** Sets the ticket of the last transfer from LazyGaspiProcessInfo::communicator. It must be taken for queue 0. */
+void set_communicator_ticket(Ticket ticket);
+/** Held while using the staging region, from waiting for its entries until their contents are no longer needed, since all 
+ *  threads share it. Also guards its tickets. */
+extern PerInstance<std::mutex> staging_mutex;
+
+/** Takes a range of read notifications (see NOTIF_ID_ROWS_READ) that no other read holds and returns its first ID. Yields while
+ *  all of them are held. */
+gaspi_notification_id_t take_read_notifications();
+/** Returns a range taken by take_read_notifications. */
+void release_read_notifications(gaspi_notification_id_t first);
+
+/** Holds a range of read notifications while in scope. */
+struct ReadNotifications{
+    const gaspi_notification_id_t first;
+    ReadNotifications() : first(take_read_notifications()) {}
+    ~ReadNotifications(){ release_read_notifications(first); }
+    ReadNotifications(const ReadNotifications&) = delete;
+    ReadNotifications& operator=(const ReadNotifications&) = delete;
+};
+
+/*  Automatic prefetching (LazyGaspiProcessInfo::auto_prefetch). Defined in prefetch.cpp. */
+
+/** Records a read of a row of another rank, with the age it was read in and the smallest slack it was read with in that age. */
+void record_read_pattern(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_slack_t slack);
+/** Prefetches the recorded rows that were read in the last LazyGaspiProcessInfo::auto_prefetch_history ages and are not fresh in
+ *  the cache yet, and forgets the others. */
+gaspi_return_t prefetch_read_pattern(LazyGaspiProcessInfo* info);
+
+/** Pushes entry `index` of the local rows segment to every rank whose prefetch request it satisfies, as soon as it was written, 
+ *  instead of in the next lazygaspi_fulfill_prefetches. If any request is pending, waits for queue 0 first, so that a write to 
+ *  the entry posted on it has completed. Defined in prefetch.cpp. */
+gaspi_return_t push_requested_row(LazyGaspiProcessInfo* info, gaspi_offset_t index);
+
+/** Copies the row kept in write-back mode (see lazygaspi_flush) with the given ID's into a slot of the local cache. Does nothing
+ *  if the row is not kept. */
+gaspi_return_t restore_kept_row(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_offset_t slot);
+
+/*  Node cache (CachingOptions::node_size). The ranks on the same host map the same POSIX shared memory object and bind it as
+ *  segment LAZYGASPI_ID_NODE_CACHE. Its entries are `sequence | tag | row`, where the tag and the row are as far apart as in the
+ *  rows segment, so that both can be read with a single transfer. The sequence is odd while a rank reads a row into the entry,
+ *  and ranks that copy an entry retry if it changed meanwhile. Defined in node_cache.cpp.
+ */
+
+/** Maps the node cache and binds it to its segment, or sets CachingOptions::node_size to 0 if the current rank is alone on its
+ *  host. Hits barriers for all. */
+gaspi_return_t node_cache_init(LazyGaspiProcessInfo* info);
+gaspi_return_t node_cache_term(LazyGaspiProcessInfo* info);
+/** Copies a row of another rank from the node cache into a slot of the local cache, after reading it from `rank` into the node
+ *  cache if it is missing or older than `min` there (unless another rank on the host is already doing so). The row in the slot
+ *  may still be older than `min`. The slot must not be the source of a pending transfer. */
+gaspi_return_t fetch_row_through_node(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index, gaspi_offset_t slot,
+                                      lazygaspi_id_t row_id, lazygaspi_id_t table_id, lazygaspi_age_t min);
+
+/*  Layout of the rows and cache segments.
+ *
+ *  By default (array of structures), an entry of the rows segment is `[lock] tag | row | n request ages` and an entry of the
+ *  cache is `[lock] tag | row`, so that the tag and the row can be moved with a single transfer.
+ *
+ *  With SOA_LAYOUT (structure of arrays), both segments are split into regions that start at a cache line boundary:
+ *      rows:  [locks] | tags | row slabs | request ages
+ *      cache: [locks] | tags | row slabs
+ *  Every row slab starts at a cache line boundary, and the request ages are stored rank-major, so that scans over tags or over
+ *  the requests of a given rank only touch the lines of the corresponding region. The rows segment of every rank reserves
+ *  `rows_capacity` entries, so that region offsets can be computed for remote ranks without knowing their row amount.
+ *
+ *  Both layouts of the rows segment end with the modification ages (see rows_modified_offset).
+ *
+ *  All offsets below are in bytes. `index` is the offset of an entry in the rows segment, as given by `get_row_location`,
+ *  and `slot` is the offset of an entry in the cache, as given by `get_offset_in_cache`.
+ */
+
+#ifdef SOA_LAYOUT
+static inline gaspi_size_t get_data_stride(const LazyGaspiProcessInfo* info){
+    return align_up(info->row_size, DATA_ALIGNMENT);
+}
+
+static inline gaspi_offset_t get_tags_base(gaspi_offset_t entries){
+    return align_up(LOCK_SIZE * entries, CACHE_LINE_SIZE);
+}
+
+static inline gaspi_offset_t get_data_base(gaspi_offset_t entries){
+    return align_up(get_tags_base(entries) + sizeof(RowTag) * entries, DATA_ALIGNMENT);
+}
 
+static inline gaspi_offset_t rows_lock_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    (void)info;
+    return LOCK_SIZE * index;
+}
+
+static inline gaspi_offset_t rows_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    return get_tags_base(info->rows_capacity) + sizeof(RowTag) * index;
+}
+
+static inline gaspi_offset_t rows_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    return get_data_base(info->rows_capacity) + get_data_stride(info) * index;
+}
+
+static inline gaspi_offset_t rows_request_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index, gaspi_rank_t rank){
+    return get_data_base(info->rows_capacity) + get_data_stride(info) * info->rows_capacity + 
+           ((gaspi_offset_t)rank * info->rows_capacity + index) * sizeof(lazygaspi_age_t);
+}
+
+static inline gaspi_size_t get_rows_entries_size(const LazyGaspiProcessInfo* info, gaspi_offset_t row_amount){
+    (void)row_amount;
+    return rows_request_offset(info, 0, info->n);
+}
+
+static inline gaspi_offset_t cache_lock_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    (void)info;
+    return LOCK_SIZE * slot;
+}
+
+static inline gaspi_offset_t cache_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    return get_tags_base(info->cacheOpts.size) + sizeof(RowTag) * slot;
+}
+
+static inline gaspi_offset_t cache_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    return get_data_base(info->cacheOpts.size) + get_data_stride(info) * slot;
+}
+
+static inline gaspi_size_t get_cache_entries_size(const LazyGaspiProcessInfo* info){
+    return cache_data_offset(info, info->cacheOpts.size);
+}
+
+static inline gaspi_size_t get_staging_entry_size(const LazyGaspiProcessInfo* info){
+    return sizeof(RowTag) + get_data_stride(info);
+}
+
+static inline gaspi_offset_t get_staging_base(const LazyGaspiProcessInfo* info){
+    return align_up(get_cache_entries_size(info), ENTRY_ALIGNMENT);
+}
 #else
-    #define ROW_METADATA_OFFSET 0
-    #define ROW_SIZE_IN_TABLE_WITH_LOCK ROW_SIZE_IN_TABLE
-    #define ROW_SIZE_IN_CACHE_WITH_LOCK ROW_SIZE_IN_CACHE
+#define ROW_LOCK_OFFSET 0
+#define ROW_METADATA_OFFSET (ROW_LOCK_OFFSET + LOCK_SIZE)
+//The tag is padded so that the row starts at a multiple of ROW_ALIGNMENT.
+#define ROW_DATA_OFFSET align_up(ROW_METADATA_OFFSET + sizeof(RowTag), DATA_ALIGNMENT)
+#define ROW_REQUEST_OFFSET(rank) (align_up(ROW_DATA_OFFSET + info->row_size, sizeof(lazygaspi_age_t)) + \
+                                  rank * sizeof(lazygaspi_age_t))
+
+//Size of the tag, its padding and the row, which are transferred together.
+#define ROW_SIZE_IN_CACHE (ROW_DATA_OFFSET - ROW_METADATA_OFFSET + info->row_size)
+//Entry strides, padded so that every entry starts at a multiple of ENTRY_ALIGNMENT.
+#define ROW_SIZE_IN_TABLE_WITH_LOCK align_up(ROW_REQUEST_OFFSET(info->n), ENTRY_ALIGNMENT)
+#define ROW_SIZE_IN_CACHE_WITH_LOCK align_up(ROW_DATA_OFFSET + info->row_size, ENTRY_ALIGNMENT)
+
+static inline gaspi_offset_t rows_lock_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    (void)info;
+    return ROW_SIZE_IN_TABLE_WITH_LOCK * index + ROW_LOCK_OFFSET;
+}
+
+static inline gaspi_offset_t rows_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    return ROW_SIZE_IN_TABLE_WITH_LOCK * index + ROW_METADATA_OFFSET;
+}
+
+static inline gaspi_offset_t rows_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index){
+    return ROW_SIZE_IN_TABLE_WITH_LOCK * index + ROW_DATA_OFFSET;
+}
+
+static inline gaspi_offset_t rows_request_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t index, gaspi_rank_t rank){
+    return ROW_SIZE_IN_TABLE_WITH_LOCK * index + ROW_REQUEST_OFFSET(rank);
+}
+
+static inline gaspi_size_t get_rows_entries_size(const LazyGaspiProcessInfo* info, gaspi_offset_t row_amount){
+    (void)row_amount;
+    return ROW_SIZE_IN_TABLE_WITH_LOCK * row_amount;
+}
+
+static inline gaspi_offset_t cache_lock_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    (void)info;
+    return ROW_SIZE_IN_CACHE_WITH_LOCK * slot + ROW_LOCK_OFFSET;
+}
+
+static inline gaspi_offset_t cache_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    return ROW_SIZE_IN_CACHE_WITH_LOCK * slot + ROW_METADATA_OFFSET;
+}
+
+static inline gaspi_offset_t cache_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t slot){
+    return ROW_SIZE_IN_CACHE_WITH_LOCK * slot + ROW_DATA_OFFSET;
+}
+
+static inline gaspi_size_t get_cache_entries_size(const LazyGaspiProcessInfo* info){
+    return ROW_SIZE_IN_CACHE_WITH_LOCK * info->cacheOpts.size;
+}
+
+//Staged entries are copies of whole entries of the rows segment.
+static inline gaspi_size_t get_staging_entry_size(const LazyGaspiProcessInfo* info){
+    return ROW_SIZE_IN_TABLE_WITH_LOCK;
+}
+
+static inline gaspi_offset_t get_staging_base(const LazyGaspiProcessInfo* info){
+    return align_up(get_cache_entries_size(info), ENTRY_ALIGNMENT);
+}
 #endif
 
-#define ROW_DATA_OFFSET (ROW_METADATA_OFFSET + sizeof(LazyGaspiRowData))
-#define ROW_REQUEST_OFFSET(rank) (ROW_DATA_OFFSET + info->row_size + rank * sizeof(lazygaspi_age_t))
+/*  The cache segment ends with a staging region, into which runs of contiguous entries of a rows segment are read with a single
+ *  transfer per region (see lazygaspi_read_range). It holds `get_staging_capacity` entries, laid out like the rows segment
+ *  (tags, then rows, with SOA_LAYOUT) but without locks and requests in the latter case. `k` is the offset of a staged entry.
+ */
+
+/** The amount of entries that fit in the staging region, or 0 if there is none. */
+static inline gaspi_offset_t get_staging_capacity(const LazyGaspiProcessInfo* info){
+    if(info->cacheOpts.staging_bytes == 0) return 0;
+    const auto capacity = info->cacheOpts.staging_bytes / get_staging_entry_size(info);
+    return capacity ? capacity : 1;
+}
+
+static inline gaspi_offset_t staging_tag_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t k){
+    #ifdef SOA_LAYOUT
+    return get_staging_base(info) + sizeof(RowTag) * k;
+    #else
+    return get_staging_base(info) + rows_tag_offset(info, k);
+    #endif
+}
+
+static inline gaspi_offset_t staging_data_offset(const LazyGaspiProcessInfo* info, gaspi_offset_t k){
+    #ifdef SOA_LAYOUT
+    return align_up(staging_tag_offset(info, get_staging_capacity(info)), DATA_ALIGNMENT) + get_data_stride(info) * k;
+    #else
+    return get_staging_base(info) + rows_data_offset(info, k);
+    #endif
+}
+
+static inline gaspi_size_t get_cache_segment_size(const LazyGaspiProcessInfo* info){
+    if(get_staging_capacity(info) == 0) return get_cache_entries_size(info);
+    #ifdef SOA_LAYOUT
+    return staging_data_offset(info, get_staging_capacity(info));
+    #else
+    return get_staging_base(info) + get_staging_entry_size(info) * get_staging_capacity(info);
+    #endif
+}
+
+/** Posts the transfer of a row (tag and data) from an entry of the rows segment of `rank` into a slot of the local cache.
+ *  Does not wait for the queue. */
+static inline gaspi_return_t read_row_to_cache(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                               gaspi_offset_t slot, gaspi_queue_id_t q = 0){
+    #ifdef SOA_LAYOUT
+    auto r = read(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_data_offset(info, index), cache_data_offset(info, slot),
+                  info->row_size, rank, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    return read(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                sizeof(RowTag), rank, GASPI_BLOCK, q);
+    #else
+    return read(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                ROW_SIZE_IN_CACHE, rank, GASPI_BLOCK, q);
+    #endif
+}
+
+/** Reads a row (tag and data) from an entry of the rows segment of `rank` into a slot of the local cache. Only waits for this 
+ *  read to complete. */
+static inline gaspi_return_t fetch_row_to_cache(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                gaspi_offset_t slot, gaspi_queue_id_t q = 0){
+    const ReadNotifications notif;
+    #ifdef SOA_LAYOUT
+    auto r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_data_offset(info, index), cache_data_offset(info, slot),
+                        info->row_size, rank, notif.first + 1, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                   sizeof(RowTag), rank, notif.first, GASPI_BLOCK, q);
+    #else
+    auto r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                        ROW_SIZE_IN_CACHE, rank, notif.first, GASPI_BLOCK, q);
+    #endif
+    ERROR_CHECK_COUT;
+    return wait_for_notifications(LAZYGASPI_ID_CACHE, notif.first, NOTIF_ROWS_READ_AMOUNT);
+}
+
+/** Posts the transfer of a row (tag and data) from a slot of the local cache into an entry of the rows segment of `rank`, 
+ *  notifying it with NOTIF_ID_ROW_WRITTEN. Does not wait for the queue. */
+static inline gaspi_return_t write_row_from_cache(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                  gaspi_offset_t slot, gaspi_queue_id_t q = 0){
+    #ifdef SOA_LAYOUT
+    auto r = write(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, cache_data_offset(info, slot), rows_data_offset(info, index),
+                   info->row_size, rank, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, cache_tag_offset(info, slot), rows_tag_offset(info, index), 
+                       sizeof(RowTag), rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+    #else
+    return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, cache_tag_offset(info, slot), rows_tag_offset(info, index), 
+                       ROW_SIZE_IN_CACHE, rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+    #endif
+}
+
+/** Posts the transfer of a row (tag and data) from an entry of the local rows segment into a slot of the cache of `rank`, 
+ *  notifying it with NOTIF_ID_ROW_PUSHED. Does not wait for the queue. */
+static inline gaspi_return_t push_row_to_cache(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                               gaspi_offset_t slot, gaspi_queue_id_t q = 0){
+    #ifdef SOA_LAYOUT
+    auto r = write(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_data_offset(info, index), cache_data_offset(info, slot),
+                   info->row_size, rank, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    return writenotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                       sizeof(RowTag), rank, NOTIF_ID_ROW_PUSHED, 1, GASPI_BLOCK, q);
+    #else
+    return writenotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), cache_tag_offset(info, slot), 
+                       ROW_SIZE_IN_CACHE, rank, NOTIF_ID_ROW_PUSHED, 1, GASPI_BLOCK, q);
+    #endif
+}
+
+/** Posts the transfer of a row (tag and data) from entry `k` of the staging region of the local cache into an entry of the rows
+ *  segment of `rank`, notifying it with NOTIF_ID_ROW_WRITTEN. Does not wait for the queue. */
+static inline gaspi_return_t write_row_from_staging(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                    gaspi_offset_t k, gaspi_queue_id_t q = 0){
+    #ifdef SOA_LAYOUT
+    auto r = write(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_data_offset(info, k), rows_data_offset(info, index),
+                   info->row_size, rank, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_tag_offset(info, k), rows_tag_offset(info, index), 
+                       sizeof(RowTag), rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+    #else
+    return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_tag_offset(info, k), rows_tag_offset(info, index), 
+                       ROW_SIZE_IN_CACHE, rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+    #endif
+}
+
+/** Reads `count` contiguous entries (tags and rows), starting at entry `index` of the rows segment of `rank`, into the staging
+ *  region of the local cache. `count` must not exceed the staging capacity, and staging_mutex must be held. Only waits for this
+ *  read to complete. */
+static inline gaspi_return_t fetch_rows_to_staging(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                   gaspi_offset_t count, gaspi_queue_id_t q = 0){
+    const ReadNotifications notif;
+    #ifdef SOA_LAYOUT
+    auto r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_data_offset(info, index), staging_data_offset(info, 0),
+                        get_data_stride(info) * count, rank, notif.first + 1, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), staging_tag_offset(info, 0), 
+                   sizeof(RowTag) * count, rank, notif.first, GASPI_BLOCK, q);
+    #else
+    auto r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_lock_offset(info, index), get_staging_base(info), 
+                        ROW_SIZE_IN_TABLE_WITH_LOCK * count, rank, notif.first, GASPI_BLOCK, q);
+    #endif
+    ERROR_CHECK_COUT;
+    return wait_for_notifications(LAZYGASPI_ID_CACHE, notif.first, NOTIF_ROWS_READ_AMOUNT);
+}
+
+/** Posts the transfer of bytes [offset, offset + length) of the row in entry `k` of the staging region, and then of its tag, into
+ *  an entry of the rows segment of `rank`, notifying it with NOTIF_ID_ROW_WRITTEN. Does not wait for the queue. */
+static inline gaspi_return_t write_part_from_staging(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                     gaspi_offset_t k, gaspi_size_t offset, gaspi_size_t length, 
+                                                     gaspi_queue_id_t q = 0){
+    #ifndef SOA_LAYOUT
+    //A part at the start of the row is contiguous with the tag.
+    if(offset == 0)
+        return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_tag_offset(info, k), rows_tag_offset(info, index),
+                           ROW_SIZE_IN_CACHE - info->row_size + length, rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+    #endif
+    if(length){
+        auto r = write(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_data_offset(info, k) + offset, 
+                       rows_data_offset(info, index) + offset, length, rank, GASPI_BLOCK, q);
+        ERROR_CHECK_COUT;
+    }
+    return writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, staging_tag_offset(info, k), rows_tag_offset(info, index), 
+                       sizeof(RowTag), rank, NOTIF_ID_ROW_WRITTEN, 1, GASPI_BLOCK, q);
+}
+
+/** Reads bytes [offset, offset + length) of a row and its tag, from an entry of the rows segment of `rank`, into entry `k` of the
+ *  staging region of the local cache, while holding staging_mutex. Only waits for this read to complete. */
+static inline gaspi_return_t fetch_part_to_staging(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index,
+                                                   gaspi_offset_t k, gaspi_size_t offset, gaspi_size_t length, 
+                                                   gaspi_queue_id_t q = 0){
+    const ReadNotifications notif;
+    gaspi_return_t r;
+    #ifndef SOA_LAYOUT
+    //A part at the start of the row is contiguous with the tag.
+    if(offset == 0){
+        r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), staging_tag_offset(info, k), 
+                       ROW_SIZE_IN_CACHE - info->row_size + length, rank, notif.first, GASPI_BLOCK, q);
+        ERROR_CHECK_COUT;
+        return wait_for_notifications(LAZYGASPI_ID_CACHE, notif.first, 1);
+    }
+    #endif
+    if(length){
+        r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_data_offset(info, index) + offset, 
+                       staging_data_offset(info, k) + offset, length, rank, notif.first + 1, GASPI_BLOCK, q);
+        ERROR_CHECK_COUT;
+    }
+    r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_tag_offset(info, index), staging_tag_offset(info, k), 
+                   sizeof(RowTag), rank, notif.first, GASPI_BLOCK, q);
+    ERROR_CHECK_COUT;
+    return wait_for_notifications(LAZYGASPI_ID_CACHE, notif.first, length ? 2 : 1);
+}
 
 struct RowLocationEntry{
     gaspi_rank_t rank;
@@ -105,6 +590,41 @@ static inline lazygaspi_age_t get_min_age(lazygaspi_age_t current, lazygaspi_age
     return (current < slack + 1 + (int)offset) ? 1 : (current - slack - (int)offset);
 }
 
+/** The info segment holds the LazyGaspiProcessInfo, followed by the clock vector: the age last published by each rank. */
+static inline gaspi_size_t get_info_segment_size(gaspi_rank_t n){
+    return sizeof(LazyGaspiProcessInfo) + n * sizeof(lazygaspi_age_t);
+}
+
+/** Offset, in bytes, of the clock of `rank` in the info segment. */
+static inline gaspi_offset_t clock_offset(gaspi_rank_t rank){
+    return sizeof(LazyGaspiProcessInfo) + rank * sizeof(lazygaspi_age_t);
+}
+
+/** Entries of the clock vector are written by other ranks at any time. */
+static inline volatile lazygaspi_age_t* get_clocks(LazyGaspiProcessInfo* info){
+    return (volatile lazygaspi_age_t*)((char*)info + sizeof(LazyGaspiProcessInfo));
+}
+
+/** Writes `age` to the clock of the current rank in the clock vector of every rank. Waits for queue 0. */
+static inline gaspi_return_t publish_clock(LazyGaspiProcessInfo* info, lazygaspi_age_t age){
+    get_clocks(info)[info->id] = age;
+    for(gaspi_rank_t i = 0; i < info->n; i++){
+        if(i == info->id) continue;
+        auto r = writecopy(LAZYGASPI_ID_INFO, clock_offset(info->id), sizeof(lazygaspi_age_t), i); ERROR_CHECK;
+    }
+    return wait_for_queue(0);
+}
+
+/** Returns false if no rank can have written a row with an age of at least `min` yet, in which case reading a row again cannot
+ *  make it fresh. Rows are tagged with their writer's age, so this is the case if the clocks of all other ranks are older than
+ *  `min` and the current rank wrote no such row itself. */
+static inline bool fresh_row_may_exist(LazyGaspiProcessInfo* info, lazygaspi_age_t min){
+    if(info->write_age >= min) return true;
+    auto clocks = get_clocks(info);
+    for(gaspi_rank_t i = 0; i < info->n; i++) if(i != info->id && clocks[i] >= min) return true;
+    return false;
+}
+
 /** Offset is in rows, not bytes. */
 static inline std::pair<gaspi_rank_t, gaspi_offset_t> get_row_location(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, 
                                                                        lazygaspi_id_t table_id){
@@ -118,6 +638,17 @@ static inline std::pair<gaspi_rank_t, gaspi_offset_t> get_row_location(LazyGaspi
     return std::make_pair((gaspi_rank_t)rank, (gaspi_offset_t)offset);
 }
 
+/** Inverse of get_row_location. Returns the row and table ID's (in this order) of an entry of a rank's rows segment. 
+ *  Offset is in rows, not bytes. */
+static inline std::pair<lazygaspi_id_t, lazygaspi_id_t> get_row_id(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, 
+                                                                   gaspi_offset_t index){
+    const auto offsetBlock = index / info->shardOpts.block_size;
+    const auto offsetInternal = index % info->shardOpts.block_size;
+    const auto absIndex = (offsetBlock * info->n + rank) * info->shardOpts.block_size + offsetInternal;
+
+    return std::make_pair((lazygaspi_id_t)(absIndex % info->table_size), (lazygaspi_id_t)(absIndex / info->table_size));
+}
+
 /** Returns the amount of rows in the given rank's rows segment. 
  *  Table amount can be obtained by dividing by the amount of rows in one table.
  * 
@@ -136,30 +667,125 @@ static inline unsigned long get_row_amount(gaspi_offset_t table_size, gaspi_offs
            ((rank == block_amount % rank_amount) ? ((table_amount * table_size) % (block_amount * opts.block_size)) : 0);
 }
 
+/*  Modification ages. The rows segment of every rank ends with one age per block of MODIFIED_BLOCK_ROWS entries: the age with 
+ *  which a row of the block was last written. Writers send it after the row (see mark_modified), so ages sent by different
+ *  ranks may arrive in any order, and it is only a hint of whether the block holds rows newer than a copy of them. Readers use 
+ *  it to skip transfers of rows whose cached copy is fresh anyway (see lazygaspi_read_range and lazygaspi_prefetch_all).
+ */
+#define MODIFIED_BLOCK_ROWS 64
+
+static inline gaspi_offset_t get_modified_block_amount(gaspi_offset_t row_amount){
+    return (row_amount + MODIFIED_BLOCK_ROWS - 1) / MODIFIED_BLOCK_ROWS;
+}
+
+static inline gaspi_offset_t rows_modified_offset(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t block){
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, rank, info->shardOpts);
+    return align_up(get_rows_entries_size(info, row_amount), sizeof(lazygaspi_age_t)) + block * sizeof(lazygaspi_age_t);
+}
+
+static inline gaspi_size_t get_rows_segment_size(const LazyGaspiProcessInfo* info, gaspi_offset_t row_amount){
+    return align_up(get_rows_entries_size(info, row_amount), sizeof(lazygaspi_age_t)) + 
+           get_modified_block_amount(row_amount) * sizeof(lazygaspi_age_t);
+}
+
+/** Advances the modification age of the block of entry `index` of the local rows segment to `age`. */
+static inline void set_modified_age(const LazyGaspiProcessInfo* info, gaspi_pointer_t rows, gaspi_offset_t index, 
+                                    lazygaspi_age_t age){
+    auto modified = (lazygaspi_age_t*)((char*)rows + rows_modified_offset(info, info->id, index / MODIFIED_BLOCK_ROWS));
+    if(*modified < age) *modified = age;
+}
+
+/** Reads `count` modification ages of `rank`, starting at the one of block `block`, into `ages`. Uses the staging region of the
+ *  local cache, which must hold at least one entry and must not be the source of a pending transfer. staging_mutex must be held. */
+static inline gaspi_return_t fetch_modified_ages(const LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t block,
+                                                 gaspi_offset_t count, lazygaspi_age_t* ages){
+    const ReadNotifications notif;
+    gaspi_pointer_t cache;
+    auto r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK_COUT;
+    //A staging entry holds at least a tag, which is no smaller than an age.
+    const auto chunk = get_staging_capacity(info);
+    for(gaspi_offset_t done = 0; done < count; done += chunk){
+        const auto amount = count - done < chunk ? count - done : chunk;
+        r = readnotify(LAZYGASPI_ID_ROWS, LAZYGASPI_ID_CACHE, rows_modified_offset(info, rank, block + done), get_staging_base(info),
+                       amount * sizeof(lazygaspi_age_t), rank, notif.first);
+        ERROR_CHECK_COUT;
+        r = wait_for_notifications(LAZYGASPI_ID_CACHE, notif.first, 1); ERROR_CHECK_COUT;
+        memcpy(ages + done, (char*)cache + get_staging_base(info), amount * sizeof(lazygaspi_age_t));
+    }
+    return GASPI_SUCCESS;
+}
+
+/** Posts the transfer of the current age into the modification age of the block of entry `index` of the rows segment of `rank`,
+ *  after a row was written to it, unless it was already sent for this block with the current age. The age is sent from 
+ *  LazyGaspiProcessInfo::age itself, so the queue must be waited for before the age changes (as lazygaspi_clock does for queue 0,
+ *  and lazygaspi_flush for the others). Defined in write.cpp. */
+gaspi_return_t mark_modified(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index, gaspi_queue_id_t q = 0);
+
 /** Offset is in rows, not bytes. */
 static inline gaspi_offset_t get_offset_in_cache(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id){
     return info->cacheOpts.hash(row_id, table_id, info) % info->cacheOpts.size;
 }
 
-/** Returns the minimum age for the current prefetch. 0 indicates no prefetching should occur. Resets flag to 0.
+//A prefetch request holds the minimum age of the requested row in its low bits and the priority of the request in its high bits.
+#define REQUEST_PRIORITY_SHIFT (8 * (sizeof(lazygaspi_age_t) - sizeof(lazygaspi_priority_t)))
+
+static inline lazygaspi_age_t make_request(lazygaspi_age_t min, lazygaspi_priority_t priority){
+    return min | ((lazygaspi_age_t)priority << REQUEST_PRIORITY_SHIFT);
+}
+
+static inline lazygaspi_age_t request_age(lazygaspi_age_t request){
+    return request & (((lazygaspi_age_t)1 << REQUEST_PRIORITY_SHIFT) - 1);
+}
+
+static inline lazygaspi_priority_t request_priority(lazygaspi_age_t request){
+    return (lazygaspi_priority_t)(request >> REQUEST_PRIORITY_SHIFT);
+}
+
+/** Returns the pending prefetch request of a rank if the row's current age satisfies it, without resetting it.
+ *  0 indicates no prefetching should occur. Requests for a newer row than the current one are kept pending.
  * 
  *  Parameters:
- *  info - A pointer to the "info" segment.
- *  rows - A pointer to the "rows" segment.
- *  row  - The offset, in bytes, of the rows table entry that contains the row and prefetch flags.
- *  rank - The rank to check for the prefetch flag.
+ *  info  - A pointer to the "info" segment.
+ *  rows  - A pointer to the "rows" segment.
+ *  index - The offset, in rows, of the rows table entry that contains the row and prefetch flags.
+ *  rank  - The rank to check for the prefetch flag.
  */
-static inline lazygaspi_age_t get_prefetch(const LazyGaspiProcessInfo* info, const gaspi_pointer_t rows, const gaspi_offset_t row, const gaspi_rank_t rank){
-    auto flag = (lazygaspi_age_t*)((bool*)rows + row + ROW_REQUEST_OFFSET(rank)); 
-    //TODO: prefetch setting/resetting need to be made atomic
-    if(*flag){
-        auto temp = *flag;
-        *flag = 0;
-        return temp;
-    }
+static inline lazygaspi_age_t get_prefetch(const LazyGaspiProcessInfo* info, const gaspi_pointer_t rows, const gaspi_offset_t index, 
+                                           const gaspi_rank_t rank){
+    auto flag = (lazygaspi_age_t*)((char*)rows + rows_request_offset(info, index, rank)); 
+    const auto request = __atomic_load_n(flag, __ATOMIC_ACQUIRE);
+    if(request && ((RowTag*)((char*)rows + rows_tag_offset(info, index)))->age >= request_age(request)) return request;
     return 0;
 }
 
+/** Resets a prefetch request returned by get_prefetch to 0. Returns false if the rank replaced the request in the meantime, in which
+ *  case the new request is kept pending. */
+static inline bool clear_prefetch(const LazyGaspiProcessInfo* info, const gaspi_pointer_t rows, const gaspi_offset_t index, 
+                                  const gaspi_rank_t rank, lazygaspi_age_t request){
+    auto flag = (lazygaspi_age_t*)((char*)rows + rows_request_offset(info, index, rank)); 
+    return __atomic_compare_exchange_n(flag, &request, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+#ifdef READ_STATS
+/** Adds a read to the histograms of its table.
+ * 
+ *  Parameters:
+ *  info     - A pointer to the "info" segment.
+ *  table_id - The ID of the read row's table.
+ *  age      - The age of the returned row.
+ *  wait_ns  - The time spent waiting for a fresh row, in nanoseconds.
+ */
+static inline void record_read(LazyGaspiProcessInfo* info, lazygaspi_id_t table_id, lazygaspi_age_t age, unsigned long wait_ns){
+    auto& histogram = info->histograms[table_id];
+    const auto staleness = info->age > age ? info->age - age : 0;
+    //Threads of the same instance may read at the same time.
+    __atomic_fetch_add(&histogram.staleness[staleness < LAZYGASPI_STALENESS_BUCKETS ? staleness : LAZYGASPI_STALENESS_BUCKETS - 1],
+                       1, __ATOMIC_RELAXED);
+    const unsigned long bucket = wait_ns ? sizeof(unsigned long) * 8 - __builtin_clzl(wait_ns) : 0;
+    __atomic_fetch_add(&histogram.wait[bucket < LAZYGASPI_WAIT_BUCKETS ? bucket : LAZYGASPI_WAIT_BUCKETS - 1], 1, __ATOMIC_RELAXED);
+}
+#endif
+
 //To prevent overflow
 static inline bool is_atomic_size_enough(LazyGaspiProcessInfo* info){
     #ifdef LOCKED_OPERATIONS
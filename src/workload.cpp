@@ -0,0 +1,262 @@
+#include "lazygaspi_hs.h"
+#include "gaspi_utils.h"
+#include "utils.h"
+#include <cstdlib>
+#include <unistd.h>
+#include <getopt.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+//Default values
+#define ITERATIONS 10
+#define OPERATIONS 1000
+#define ZIPF_EXPONENT 0.99
+#define HOT_FRACTION 0.1
+#define HOT_PROBABILITY 0.9
+#define SEED 42
+
+void print_usage();
+
+enum Distribution { DIST_UNIFORM, DIST_ZIPF, DIST_HOTSPOT };
+static const char* distribution_names[] = { "uniform", "zipf", "hotspot" };
+
+struct WorkloadParams{
+    lazygaspi_id_t table_size, table_amount, block_size;
+    gaspi_size_t row_size, cache_size;
+    unsigned iterations, operations;
+    Distribution distribution;
+    double zipf_exponent, hot_fraction, hot_probability;
+    //Relative weights of reads, writes and prefetches.
+    double mix[3];
+    lazygaspi_slack_t slack;
+    //Compute delay per iteration, in microseconds, and how much more of it (and of the operations) the last rank gets.
+    double delay_us, imbalance;
+    unsigned long seed;
+};
+
+/** Draws rows (as indices into all rows of all tables) from the chosen distribution. Popularity follows a permutation of all
+ *  rows that is the same on every rank, so that all ranks share the same hot rows, which are spread over all tables and ranks. */
+class RowSampler{
+    const WorkloadParams& p;
+    std::vector<lazygaspi_id_t> by_popularity;
+    std::vector<double> zipf_cdf;
+    std::uniform_real_distribution<double> unit;
+
+public:
+    RowSampler(const WorkloadParams& p) : p(p), by_popularity(p.table_size * p.table_amount), unit(0.0, 1.0){
+        for(size_t i = 0; i < by_popularity.size(); i++) by_popularity[i] = i;
+        std::mt19937_64 shared(p.seed);
+        std::shuffle(by_popularity.begin(), by_popularity.end(), shared);
+        if(p.distribution == DIST_ZIPF){
+            zipf_cdf.resize(by_popularity.size());
+            double sum = 0;
+            for(size_t i = 0; i < zipf_cdf.size(); i++) zipf_cdf[i] = sum += 1.0 / std::pow(i + 1, p.zipf_exponent);
+            for(auto& c : zipf_cdf) c /= sum;
+        }
+    }
+
+    void next(std::mt19937_64& gen, lazygaspi_id_t* row, lazygaspi_id_t* table){
+        const size_t total = by_popularity.size();
+        size_t k;
+        switch(p.distribution){
+            case DIST_ZIPF:
+                k = std::lower_bound(zipf_cdf.begin(), zipf_cdf.end(), unit(gen)) - zipf_cdf.begin();
+                if(k >= total) k = total - 1;
+                break;
+            case DIST_HOTSPOT: {
+                const size_t hot = std::max<size_t>(1, std::min<size_t>(total, p.hot_fraction * total));
+                if(hot == total || unit(gen) < p.hot_probability) k = gen() % hot;
+                else k = hot + gen() % (total - hot);
+                break;
+            }
+            default: k = gen() % total;
+        }
+        *row = by_popularity[k] % p.table_size;
+        *table = by_popularity[k] / p.table_size;
+    }
+};
+
+/** Reduces the latencies (in seconds) measured by all ranks for one operation and prints them as a JSON object on rank 0.
+ *  Must be called by all ranks, in the same order. */
+void report(LazyGaspiProcessInfo* info, const WorkloadParams& p, const char* op, std::vector<double>& latencies){
+    std::sort(latencies.begin(), latencies.end());
+    const double count = latencies.size();
+    double total = 0;
+    for(auto l : latencies) total += l;
+    const auto percentile = [&](double q){ return count ? latencies[(size_t)(q * (count - 1))] : 0.0; };
+
+    //Sums: calls, calls per second, mean latency. Maxima: mean, p50, p99, p99.9 and maximum latency.
+    double sums[3] = { count, total > 0 ? count / total : 0.0, count ? total / count : 0.0 }, sums_out[3];
+    double maxs[5] = { count ? total / count : 0.0, percentile(0.5), percentile(0.99), percentile(0.999),
+                       count ? latencies.back() : 0.0 }, maxs_out[5];
+    SUCCESS_OR_DIE(gaspi_allreduce(sums, sums_out, 3, GASPI_OP_SUM, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+    SUCCESS_OR_DIE(gaspi_allreduce(maxs, maxs_out, 5, GASPI_OP_MAX, GASPI_TYPE_DOUBLE, GASPI_GROUP_ALL, GASPI_BLOCK));
+
+    if(info->id != 0) return;
+    std::cout << "{\"op\": \"" << op << "\", \"ranks\": " << info->n << ", \"table_size\": " << p.table_size
+              << ", \"table_amount\": " << p.table_amount << ", \"row_size\": " << info->row_size
+              << ", \"block_size\": " << info->shardOpts.block_size << ", \"cache_size\": " << info->cacheOpts.size
+              << ", \"iterations\": " << p.iterations << ", \"operations\": " << p.operations
+              << ", \"distribution\": \"" << distribution_names[p.distribution] << '"';
+    if(p.distribution == DIST_ZIPF) std::cout << ", \"zipf_exponent\": " << p.zipf_exponent;
+    if(p.distribution == DIST_HOTSPOT) std::cout << ", \"hot_fraction\": " << p.hot_fraction
+                                                 << ", \"hot_probability\": " << p.hot_probability;
+    std::cout << ", \"mix\": [" << p.mix[0] << ", " << p.mix[1] << ", " << p.mix[2] << "], \"slack\": " << p.slack
+              << ", \"delay_us\": " << p.delay_us << ", \"imbalance\": " << p.imbalance
+              #ifdef LOCKED_OPERATIONS
+              << ", \"locked\": true"
+              #else
+              << ", \"locked\": false"
+              #endif
+              << ", \"calls\": " << (unsigned long)sums_out[0] << ", \"throughput_per_s\": " << sums_out[1]
+              << ", \"latency_us\": {\"mean\": " << sums_out[2] / info->n * 1e6 << ", \"max_rank_mean\": " << maxs_out[0] * 1e6
+              << ", \"p50\": " << maxs_out[1] * 1e6 << ", \"p99\": " << maxs_out[2] * 1e6 << ", \"p999\": " << maxs_out[3] * 1e6
+              << ", \"max\": " << maxs_out[4] * 1e6 << "}}" << std::endl;
+}
+
+/** Commits every row of the current rank, so that rows which are never written by the mix still become fresh each age. */
+bool touch_row(lazygaspi_id_t, lazygaspi_id_t, void*, lazygaspi_age_t, void*){ return true; }
+
+/** Busy-waits, as computation would, instead of yielding the core. */
+void compute(double us){
+    const auto end = get_time() + us * 1e-6;
+    while(get_time() < end);
+}
+
+bool parse_mix(const char* arg, double* mix){
+    if(sscanf(arg, "%lf:%lf:%lf", mix, mix + 1, mix + 2) != 3) return false;
+    return mix[0] >= 0 && mix[1] >= 0 && mix[2] >= 0 && mix[0] + mix[1] + mix[2] > 0;
+}
+
+int main(int argc, char** argv){
+    int            ch;
+    WorkloadParams p = { 0, 0, 0, 0, 0, ITERATIONS, OPERATIONS, DIST_UNIFORM, ZIPF_EXPONENT, HOT_FRACTION, HOT_PROBABILITY,
+                         { 80, 15, 5 }, 0, 0, 0, SEED };
+
+    while((ch = getopt(argc, argv, "hk:n:r:b:c:i:o:d:z:H:P:m:s:D:I:S:")) != -1) {
+        switch(ch){
+            case 'k': p.table_size = atol(optarg); break;
+            case 'n': p.table_amount = atol(optarg); break;
+            case 'r': p.row_size = atol(optarg); break;
+            case 'b': p.block_size = atol(optarg); break;
+            case 'c': p.cache_size = atol(optarg); break;
+            case 'i': p.iterations = atol(optarg); break;
+            case 'o': p.operations = atol(optarg); break;
+            case 'd':
+                if(!strcmp(optarg, "uniform")) p.distribution = DIST_UNIFORM;
+                else if(!strcmp(optarg, "zipf")) p.distribution = DIST_ZIPF;
+                else if(!strcmp(optarg, "hotspot")) p.distribution = DIST_HOTSPOT;
+                else { print_usage(); exit(EXIT_FAILURE); }
+                break;
+            case 'z': p.zipf_exponent = atof(optarg); break;
+            case 'H': p.hot_fraction = atof(optarg); break;
+            case 'P': p.hot_probability = atof(optarg); break;
+            case 'm': if(!parse_mix(optarg, p.mix)) { print_usage(); exit(EXIT_FAILURE); } break;
+            case 's': p.slack = atol(optarg); break;
+            case 'D': p.delay_us = atof(optarg); break;
+            case 'I': p.imbalance = atof(optarg); break;
+            case 'S': p.seed = atol(optarg); break;
+            case '?':
+            case ':':
+            default : print_usage(); exit(EXIT_FAILURE);
+            case 'h': print_usage(); exit(EXIT_SUCCESS);
+        }
+    }
+
+    if(p.table_size == 0 || p.table_amount == 0 || p.row_size == 0 || p.iterations == 0){
+        print_usage(); exit(EXIT_FAILURE);
+    }
+
+    SUCCESS_OR_DIE_COUT(lazygaspi_init(p.table_amount, p.table_size, p.row_size, ShardingOptions(p.block_size),
+                                       CachingOptions(LAZYGASPI_HS_HASH_ROW, p.cache_size)));
+
+    LazyGaspiProcessInfo* info;
+    SUCCESS_OR_DIE_COUT(lazygaspi_get_info(&info));
+
+    //Rank i gets (1 + imbalance * i / (n - 1)) times the operations and the compute delay of rank 0.
+    const double scale = 1 + (info->n > 1 ? p.imbalance * info->id / (info->n - 1) : 0);
+    const unsigned long operations = p.operations * scale;
+    const double delay_us = p.delay_us * scale;
+
+    RowSampler sampler(p);
+    std::mt19937_64 gen(p.seed + 1 + info->id);
+    std::discrete_distribution<int> mix({ p.mix[0], p.mix[1], p.mix[2] });
+
+    auto buffer = (char*)malloc(p.row_size);
+    memset(buffer, info->id, p.row_size);
+
+    std::vector<double> ops[3], commit, fulfill, clock, iteration;
+    static const char* op_names[] = { "read", "write", "prefetch" };
+
+    for(unsigned it = 0; it < p.iterations; it++){
+        const auto it_beg = get_time();
+        auto beg = it_beg;
+        SUCCESS_OR_DIE(lazygaspi_clock());
+        clock.push_back(get_time() - beg);
+
+        beg = get_time();
+        SUCCESS_OR_DIE(lazygaspi_for_each_local(touch_row));
+        commit.push_back(get_time() - beg);
+
+        for(unsigned long i = 0; i < operations; i++){
+            lazygaspi_id_t row, table;
+            sampler.next(gen, &row, &table);
+            const auto op = mix(gen);
+            beg = get_time();
+            switch(op){
+                case 0: SUCCESS_OR_DIE(lazygaspi_read(row, table, p.slack, buffer)); break;
+                case 1: SUCCESS_OR_DIE(lazygaspi_write(row, table, buffer)); break;
+                case 2: SUCCESS_OR_DIE(lazygaspi_prefetch(&row, &table, 1, p.slack)); break;
+            }
+            ops[op].push_back(get_time() - beg);
+        }
+
+        beg = get_time();
+        SUCCESS_OR_DIE(lazygaspi_fulfill_prefetches());
+        fulfill.push_back(get_time() - beg);
+
+        compute(delay_us);
+        iteration.push_back(get_time() - it_beg);
+    }
+
+    SUCCESS_OR_DIE(GASPI_BARRIER);
+    for(int op = 0; op < 3; op++) report(info, p, op_names[op], ops[op]);
+    report(info, p, "commit_local", commit);
+    report(info, p, "fulfill_prefetches", fulfill);
+    report(info, p, "clock", clock);
+    report(info, p, "iteration", iteration);
+
+    SUCCESS_OR_DIE(lazygaspi_term());
+
+    free(buffer);
+
+    return EXIT_SUCCESS;
+}
+
+void print_usage(){
+    std::cout << "Usage: gaspi_run <...args...> -k <rows_per_table> -n <amount_of_tables> -r <row_size> [OPTIONS]\n\n"
+              << "Parameters:\n"
+              << "  -k <rows_per_table>:    The amount of rows in one table.\n"
+              << "  -n <amount_of_tables>:  The total amount of tables.\n"
+              << "  -r <row_size>:          The size of a single row, in bytes.\n"
+              << "  [-b <block_size>]:      The sharding block size, in rows. Default is one table.\n"
+              << "  [-c <cache_size>]:      The size of the cache, in rows. Default is one table.\n"
+              << "  [-i <iterations>]:      The amount of iterations. Default is " << ITERATIONS << ".\n"
+              << "  [-o <operations>]:      The amount of operations per iteration of rank 0. Default is " << OPERATIONS << ".\n"
+              << "  [-d <distribution>]:    How rows are chosen: uniform, zipf or hotspot. Default is uniform.\n"
+              << "  [-z <exponent>]:        The exponent of the Zipfian distribution. Default is " << ZIPF_EXPONENT << ".\n"
+              << "  [-H <fraction>]:        The fraction of all rows that are hot, for hotspot. Default is " << HOT_FRACTION << ".\n"
+              << "  [-P <probability>]:     The probability of choosing a hot row, for hotspot. Default is " << HOT_PROBABILITY << ".\n"
+              << "  [-m <r>:<w>:<p>]:       The relative weights of reads, writes and prefetches. Default is 80:15:5.\n"
+              << "  [-s <slack>]:           The slack of reads and prefetches. Default is 0.\n"
+              << "  [-D <microseconds>]:    The compute delay per iteration of rank 0. Default is 0.\n"
+              << "  [-I <imbalance>]:       How much more operations and compute delay the last rank gets than rank 0 (e.g.,\n"
+              << "                          1 means twice as much), scaled linearly over the ranks in between. Default is 0.\n"
+              << "  [-S <seed>]:            The random seed. Default is " << SEED << ".\n\n"
+              << "Results are printed by rank 0 as one JSON object per operation.\n"
+              << std::endl;
+}
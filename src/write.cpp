@@ -2,6 +2,11 @@
 #include "utils.h"
 #include "gaspi_utils.h"
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 
 #ifdef LOCKED_OPERATIONS
 gaspi_return_t lock_row_for_write(const LazyGaspiProcessInfo* info, const gaspi_segment_id_t seg, const gaspi_offset_t offset, 
@@ -9,6 +14,7 @@ gaspi_return_t lock_row_for_write(const LazyGaspiProcessInfo* info, const gaspi_
     gaspi_atomic_value_t oldval;
     gaspi_return_t r;
     PRINT_DEBUG_INTERNAL(" | : Locking row from segment " << (int)seg << " at offset " << offset << " of rank " << rank << " for WRITE.");
+    TRACE_SCOPE(TRACE_LOCK_SPIN);
     do{
         r = gaspi_atomic_compare_swap(seg, offset, rank, 0, LOCK_MASK_WRITE, &oldval, GASPI_BLOCK); ERROR_CHECK;
         PRINT_DEBUG_INTERNAL(" | : > Compare and swap saw " << oldval);
@@ -21,22 +27,160 @@ gaspi_return_t unlock_row_from_write(LazyGaspiProcessInfo* info, const gaspi_seg
     gaspi_return_t r;
     PRINT_DEBUG_INTERNAL(" | : Unlocking row from segment " << (int)seg << " at offset " << offset << " of rank " << rank << " from WRITE.");
 
-    if(wait_on_q) { r = gaspi_wait(q, GASPI_BLOCK); ERROR_CHECK; }
-    info->communicator = 0;
+    if(wait_on_q) { r = wait_for_queue(q); ERROR_CHECK; }
+    r = set_communicator(info, 0); ERROR_CHECK;
     r = gaspi_write(LAZYGASPI_ID_INFO, offsetof(LazyGaspiProcessInfo, communicator), rank, seg, offset, 
                     sizeofmember(LazyGaspiProcessInfo, communicator), q, GASPI_BLOCK);
     ERROR_CHECK;
-    r = gaspi_wait(q, GASPI_BLOCK); ERROR_CHECK;
+    r = wait_for_queue(q); ERROR_CHECK;
     return GASPI_SUCCESS;
 }
 #endif
 
+//A row written in write-back mode, kept until lazygaspi_flush sends it to its rank.
+struct KeptRow{
+    gaspi_rank_t rank;
+    gaspi_offset_t index;
+    RowTag tag;
+    //Offset of the row's data in KeptRows::data.
+    size_t offset;
+};
+
+//Kept rows are not stored in the cache itself, since rows pushed by other ranks may replace them there at any time.
+struct KeptRows{
+    std::vector<KeptRow> rows;
+    std::vector<char> data;
+    //Position in rows of each kept row, by the row's index in all tables (table_id * table_size + row_id).
+    std::unordered_map<gaspi_offset_t, size_t> positions;
+};
+static PerInstance<KeptRows> kept_state;
+
+//Per block of the rows segment of every rank (rank-major): the last age sent by mark_modified.
+static PerInstance<std::vector<lazygaspi_age_t>> marked_ages;
+
+//The staging entry used by the next call to lazygaspi_write_part. Atomic, since threads may write parts concurrently.
+static PerInstance<std::atomic<gaspi_offset_t>> next_part_entry;
+
+gaspi_return_t mark_modified(LazyGaspiProcessInfo* info, gaspi_rank_t rank, gaspi_offset_t index, gaspi_queue_id_t q){
+    const auto blocks = get_modified_block_amount(info->rows_capacity);
+    if(marked_ages->size() != info->n * blocks) marked_ages->assign(info->n * blocks, 0);
+    const auto block = index / MODIFIED_BLOCK_ROWS;
+    auto& marked = (*marked_ages)[rank * blocks + block];
+    if(marked == info->age) return GASPI_SUCCESS;
+    marked = info->age;
+    return write(LAZYGASPI_ID_INFO, LAZYGASPI_ID_ROWS, offsetof(LazyGaspiProcessInfo, age), rows_modified_offset(info, rank, block),
+                 sizeof(lazygaspi_age_t), rank, GASPI_BLOCK, q);
+}
+
+static void keep_row(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_rank_t rank, 
+                     gaspi_offset_t index, const void* row){
+    auto inserted = kept_state->positions.emplace(table_id * info->table_size + row_id, kept_state->rows.size());
+    if(inserted.second){
+        kept_state->rows.push_back({rank, index, RowTag(info->age, row_id, table_id), kept_state->data.size()});
+        kept_state->data.resize(kept_state->data.size() + info->row_size);
+    }
+    auto& kept = kept_state->rows[inserted.first->second];
+    kept.tag = RowTag(info->age, row_id, table_id);
+    memcpy(kept_state->data.data() + kept.offset, row, info->row_size);
+    PRINT_DEBUG_INTERNAL(" | Kept row until next flush. " << kept_state->rows.size() << " rows are kept.");
+}
+
+gaspi_return_t restore_kept_row(LazyGaspiProcessInfo* info, lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_offset_t slot){
+    auto it = kept_state->positions.find(table_id * info->table_size + row_id);
+    if(it == kept_state->positions.end()) return GASPI_SUCCESS;
+
+    PRINT_DEBUG_INTERNAL(" | Restoring kept row into the cache...");
+    gaspi_pointer_t cache;
+    auto r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+    const auto& kept = kept_state->rows[it->second];
+    r = wait_for_slot(info, slot); ERROR_CHECK;
+
+    #ifdef LOCKED_OPERATIONS
+        r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id); ERROR_CHECK;
+    #endif
+
+    memcpy((char*)cache + cache_tag_offset(info, slot), &kept.tag, sizeof(RowTag));
+    memcpy((char*)cache + cache_data_offset(info, slot), kept_state->data.data() + kept.offset, info->row_size);
+
+    #ifdef LOCKED_OPERATIONS
+        r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id, 0, false); ERROR_CHECK;
+    #endif
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_flush(){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    if(kept_state->rows.empty()) return GASPI_SUCCESS;
+
+    PRINT_DEBUG_INTERNAL("Flushing " << kept_state->rows.size() << " kept rows...");
+    TRACE_SCOPE(TRACE_WRITE);
+
+    gaspi_number_t queue_amount;
+    r = gaspi_queue_num(&queue_amount); ERROR_CHECK;
+
+    std::sort(kept_state->rows.begin(), kept_state->rows.end(), [](const KeptRow& a, const KeptRow& b){
+        return a.rank != b.rank ? a.rank < b.rank : a.index < b.index;
+    });
+
+    gaspi_pointer_t cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+    std::lock_guard<std::mutex> staging_lock(*staging_mutex);
+    //Partial writes might still be sent from the staging region.
+    r = wait_for_staging(info); ERROR_CHECK;
+
+    const auto capacity = get_staging_capacity(info);
+    for(size_t begin = 0; begin < kept_state->rows.size(); begin += capacity){
+        const auto end = std::min(begin + capacity, kept_state->rows.size());
+        //Each rank's rows go to the next queue, so rows for different ranks are transferred concurrently.
+        gaspi_queue_id_t q = 0;
+        gaspi_number_t queues_used = 1;
+        for(auto k = begin; k < end; k++){
+            const auto& kept = kept_state->rows[k];
+            if(k > begin && kept.rank != kept_state->rows[k - 1].rank){
+                q = (q + 1) % queue_amount;
+                if(queues_used < queue_amount) queues_used++;
+            }
+            memcpy((char*)cache + staging_tag_offset(info, k - begin), &kept.tag, sizeof(RowTag));
+            memcpy((char*)cache + staging_data_offset(info, k - begin), kept_state->data.data() + kept.offset, info->row_size);
+
+            #ifdef LOCKED_OPERATIONS
+                r = lock_row_for_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, kept.index), kept.rank); ERROR_CHECK;
+            #endif
+            r = write_row_from_staging(info, kept.rank, kept.index, k - begin, q); ERROR_CHECK;
+            r = mark_modified(info, kept.rank, kept.index, q); ERROR_CHECK;
+        }
+
+        for(gaspi_queue_id_t i = 0; i < queues_used; i++) { r = wait_for_queue(i); ERROR_CHECK; }
+
+        #ifdef LOCKED_OPERATIONS
+            for(auto k = begin; k < end; k++){
+                const auto& kept = kept_state->rows[k];
+                r = unlock_row_from_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, kept.index), kept.rank, 0, false);
+                ERROR_CHECK;
+            }
+        #endif
+
+        for(auto k = begin; k < end; k++) if(kept_state->rows[k].rank == info->id){
+            r = push_requested_row(info, kept_state->rows[k].index); ERROR_CHECK;
+        }
+    }
+
+    PRINT_DEBUG_INTERNAL(" | Flushed all kept rows.");
+    kept_state->rows.clear();
+    kept_state->data.clear();
+    kept_state->positions.clear();
+    return GASPI_SUCCESS;
+}
+
 gaspi_return_t lazygaspi_write(lazygaspi_id_t row_id, lazygaspi_id_t table_id, void* row){
 
     LazyGaspiProcessInfo* info;
     auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
 
     PRINT_DEBUG_INTERNAL("Writing row " << row_id << " of table " << table_id << "...");
+    TRACE_SCOPE(TRACE_WRITE, row_id, table_id);
     
     #ifdef SAFETY_CHECKS
     if(row == nullptr){
@@ -54,51 +198,227 @@ gaspi_return_t lazygaspi_write(lazygaspi_id_t row_id, lazygaspi_id_t table_id, v
     #endif
 
     gaspi_rank_t rank; 
-    gaspi_offset_t offset;
-    std::tie(rank, offset) = get_row_location(info, row_id, table_id); 
-    offset *= ROW_SIZE_IN_TABLE_WITH_LOCK;
+    gaspi_offset_t index;
+    std::tie(rank, index) = get_row_location(info, row_id, table_id); 
 
-    auto offset_cache = get_offset_in_cache(info, row_id, table_id) * ROW_SIZE_IN_CACHE_WITH_LOCK;
+    auto slot = get_offset_in_cache(info, row_id, table_id);
 
     PRINT_DEBUG_INTERNAL(" | Writing row to rank " << rank << " and an age of " << info->age << ", where the rows offset is " 
-                        << offset + ROW_METADATA_OFFSET << " bytes and cache offset is " <<  offset_cache + ROW_METADATA_OFFSET 
+                        << rows_tag_offset(info, index) << " bytes and cache offset is " <<  cache_tag_offset(info, slot) 
                         << " bytes. Cache size is " << info->cacheOpts.size << " entries.");
 
     //Write to cache.
     gaspi_pointer_t cache;
     r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
-    auto data = LazyGaspiRowData(info->age, row_id, table_id);
+    auto data = RowTag(info->age, row_id, table_id);
+    info->write_age = info->age;
+    LOG_EVENT(LOG_WRITE, row_id, table_id, rank, info->age);
 
     #ifdef LOCKED_OPERATIONS
-        lock_row_for_write(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
+        lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
     #endif
 
+    r = wait_for_slot(info, slot); ERROR_CHECK;
     //Save the row in the cache first
-    memcpy((char*)cache + offset_cache + ROW_METADATA_OFFSET, &data, sizeof(LazyGaspiRowData));
-    memcpy((char*)cache + offset_cache + ROW_DATA_OFFSET, row, info->row_size);
+    memcpy((char*)cache + cache_tag_offset(info, slot), &data, sizeof(RowTag));
+    memcpy((char*)cache + cache_data_offset(info, slot), row, info->row_size);
+
+    if(info->write_back && get_staging_capacity(info)){
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id, 0, false);
+            ERROR_CHECK;
+        #endif
+        keep_row(info, row_id, table_id, rank, index, row);
+        return GASPI_SUCCESS;
+    }
+    //A kept row would otherwise be sent after this one and overwrite it.
+    if(!kept_state->rows.empty()) { r = lazygaspi_flush(); ERROR_CHECK; }
 
     #ifdef LOCKED_OPERATIONS
-        r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id, 0, false);
+        r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id, 0, false);
         ERROR_CHECK;
-        r = lock_row_for_read(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
+        r = lock_row_for_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
         ERROR_CHECK;
-        r = lock_row_for_write(info, LAZYGASPI_ID_ROWS, offset + ROW_LOCK_OFFSET, info->id);
+        r = lock_row_for_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), info->id);
         ERROR_CHECK;
     #endif
 
     //Write to rows segment of proper rank.
-    r = writenotify(LAZYGASPI_ID_CACHE, LAZYGASPI_ID_ROWS, offset_cache + ROW_METADATA_OFFSET, offset + ROW_METADATA_OFFSET, 
-            ROW_SIZE_IN_CACHE, rank, NOTIF_ID_ROW_WRITTEN);
+    r = write_row_from_cache(info, rank, index, slot);
     ERROR_CHECK;
+    r = mark_modified(info, rank, index); ERROR_CHECK;
 
     #ifdef LOCKED_OPERATIONS
-        r = unlock_row_from_write(info, LAZYGASPI_ID_ROWS, offset + ROW_LOCK_OFFSET, info->id);
+        r = unlock_row_from_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), info->id);
+        ERROR_CHECK;
+        r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id);
         ERROR_CHECK;
-        r = unlock_row_from_read(info, LAZYGASPI_ID_CACHE, offset_cache + ROW_LOCK_OFFSET, info->id);
-        if(r != GASPI_SUCCESS) PRINT_ON_ERROR(r);
-        return r;
     #else 
-        return gaspi_wait(0, GASPI_BLOCK);  //Make sure write request is fulfilled before cache is used again for another write.
+        //The slot is only waited for before it is changed again.
+        set_slot_ticket(info, slot, take_ticket());
     #endif
+
+    if(rank == info->id) { r = push_requested_row(info, index); ERROR_CHECK; }
+    return GASPI_SUCCESS;
 }
 
+
+gaspi_return_t lazygaspi_write_part(lazygaspi_id_t row_id, lazygaspi_id_t table_id, gaspi_size_t offset, gaspi_size_t length,
+                                    const void* part){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    PRINT_DEBUG_INTERNAL("Writing " << length << " bytes at offset " << offset << " of row " << row_id << " of table " 
+                         << table_id << "...");
+    TRACE_SCOPE(TRACE_WRITE, row_id, table_id);
+
+    #ifdef SAFETY_CHECKS
+    if(part == nullptr){
+        PRINT_ON_ERROR("Tried to write nullptr as a part of a row.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(row_id >= info->table_size || table_id >= info->table_amount){
+        PRINT_ON_ERROR("Row/table ID was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    if(offset > info->row_size || length > info->row_size - offset){
+        PRINT_ON_ERROR("Part of the row was out of bounds.");
+        return GASPI_ERR_INV_NUM;
+    }
+    if(info->age == 0){
+        PRINT_ON_ERROR("Clock must be called at least once before rows are written.");
+        return GASPI_ERR_NOINIT;
+    }
+    #endif
+
+    //The part is sent together with a tag, from an entry of the staging region.
+    const auto capacity = get_staging_capacity(info);
+    if(capacity == 0){
+        PRINT_ON_ERROR("Parts of rows can only be written through a staging region (CachingOptions::staging_bytes).");
+        return GASPI_ERR_INV_SEGSIZE;
+    }
+
+    gaspi_rank_t rank; 
+    gaspi_offset_t index;
+    std::tie(rank, index) = get_row_location(info, row_id, table_id); 
+    const auto slot = get_offset_in_cache(info, row_id, table_id);
+    const auto tag = RowTag(info->age, row_id, table_id);
+    info->write_age = info->age;
+
+    gaspi_pointer_t cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+    auto cached = (RowTag*)((char*)cache + cache_tag_offset(info, slot));
+
+    //A kept row is sent whole, so the part is applied to it instead.
+    auto kept = kept_state->positions.find(table_id * info->table_size + row_id);
+    const bool is_kept = kept != kept_state->positions.end();
+
+    //The part is applied to a cached copy of the row. Its age is only advanced if it is the kept row, since the rest of the row
+    //might still be older than the part.
+    if(cached->row_id == row_id && cached->table_id == table_id){
+        r = wait_for_slot(info, slot); ERROR_CHECK;
+        #ifdef LOCKED_OPERATIONS
+            r = lock_row_for_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id); ERROR_CHECK;
+        #endif
+        memcpy((char*)cache + cache_data_offset(info, slot) + offset, part, length);
+        if(is_kept) *cached = tag;
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_write(info, LAZYGASPI_ID_CACHE, cache_lock_offset(info, slot), info->id, 0, false); ERROR_CHECK;
+        #endif
+    }
+
+    if(is_kept){
+        auto& row = kept_state->rows[kept->second];
+        row.tag = tag;
+        memcpy(kept_state->data.data() + row.offset + offset, part, length);
+        PRINT_DEBUG_INTERNAL(" | Applied part to kept row.");
+        return GASPI_SUCCESS;
+    }
+
+    {
+        //Entries are used in turn, so that a part only waits for the transfer of the part sent `capacity` writes before it.
+        const auto k = next_part_entry->fetch_add(1, std::memory_order_relaxed) % capacity;
+        std::lock_guard<std::mutex> staging_lock(*staging_mutex);
+        r = wait_for_staging(info, k); ERROR_CHECK;
+        memcpy((char*)cache + staging_tag_offset(info, k), &tag, sizeof(RowTag));
+        memcpy((char*)cache + staging_data_offset(info, k) + offset, part, length);
+
+        PRINT_DEBUG_INTERNAL(" | Writing part to rank " << rank << " through staging entry " << k << '.');
+
+        #ifdef LOCKED_OPERATIONS
+            r = lock_row_for_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank); ERROR_CHECK;
+        #endif
+        r = write_part_from_staging(info, rank, index, k, offset, length); ERROR_CHECK;
+        r = mark_modified(info, rank, index); ERROR_CHECK;
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, index), rank); ERROR_CHECK;
+        #endif
+        set_staging_ticket(info, k, take_ticket());
+    }
+
+    if(rank == info->id) { r = push_requested_row(info, index); ERROR_CHECK; }
+    return GASPI_SUCCESS;
+}
+
+gaspi_return_t lazygaspi_for_each_local(LocalRowVisitor visitor, void* data){
+    LazyGaspiProcessInfo* info;
+    auto r = lazygaspi_get_info(&info); ERROR_CHECK_COUT;
+
+    #ifdef SAFETY_CHECKS
+    if(visitor == nullptr){
+        PRINT_ON_ERROR("Tried to visit local rows with nullptr.");
+        return GASPI_ERR_NULLPTR;
+    }
+    if(info->age == 0){
+        PRINT_ON_ERROR("Clock must be called at least once before rows are written.");
+        return GASPI_ERR_NOINIT;
+    }
+    #endif
+
+    const auto row_amount = get_row_amount(info->table_size, info->table_amount, info->n, info->id, info->shardOpts);
+    PRINT_DEBUG_INTERNAL("Visiting " << row_amount << " local rows...");
+    if(row_amount == 0) return GASPI_SUCCESS;
+
+    //Kept rows were written before the visit, so they must not be sent after it.
+    r = lazygaspi_flush(); ERROR_CHECK;
+
+    gaspi_pointer_t rows, cache;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_ROWS, &rows); ERROR_CHECK;
+    r = gaspi_segment_ptr(LAZYGASPI_ID_CACHE, &cache); ERROR_CHECK;
+
+    lazygaspi_id_t row_id, table_id;
+    gaspi_offset_t committed = 0;
+    for(gaspi_offset_t i = 0; i < row_amount; i++){
+        std::tie(row_id, table_id) = get_row_id(info, info->id, i);
+        auto tag = (RowTag*)((char*)rows + rows_tag_offset(info, i));
+
+        #ifdef LOCKED_OPERATIONS
+            r = lock_row_for_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id); ERROR_CHECK;
+        #endif
+
+        const bool commit = visitor(row_id, table_id, (char*)rows + rows_data_offset(info, i), tag->age, data);
+        if(commit){
+            *tag = RowTag(info->age, row_id, table_id);
+            set_modified_age(info, rows, i, info->age);
+            committed++;
+            //The local cache might hold the previous row with the same age. Make sure it is read again.
+            const auto slot = get_offset_in_cache(info, row_id, table_id);
+            auto cached = (RowTag*)((char*)cache + cache_tag_offset(info, slot));
+            if(cached->row_id == row_id && cached->table_id == table_id){
+                r = wait_for_slot(info, slot); ERROR_CHECK;
+                cached->age = 0;
+            }
+        }
+
+        #ifdef LOCKED_OPERATIONS
+            r = unlock_row_from_write(info, LAZYGASPI_ID_ROWS, rows_lock_offset(info, i), info->id, 0, false); ERROR_CHECK;
+        #endif
+        if(commit) { r = push_requested_row(info, i); ERROR_CHECK; }
+    }
+
+    PRINT_DEBUG_INTERNAL(" | Committed " << committed << " rows.");
+    if(committed) info->write_age = info->age;
+    //Same notice a write to the rows segment leaves, so that prefetch requests for the committed rows are fulfilled.
+    if(committed) return send_notification(LAZYGASPI_ID_ROWS, info->id, NOTIF_ID_ROW_WRITTEN);
+    return GASPI_SUCCESS;
+}